@@ -0,0 +1,268 @@
+/* kcheck: differential check of the vectorized filter kernels.
+ *
+ * Samples model/sequence pairs, runs the SSV, MSV and Viterbi filters
+ * on each, and checks the MSV and Viterbi filter scores against the
+ * reference Viterbi implementation, with the generic profile rounded
+ * to each filter's limited precision (p7_profile_SameAsMF(),
+ * p7_profile_SameAsVF()), so correct filters agree to within
+ * float rounding. Each kernel is timed on the same pairs.
+ *
+ * Only one SIMD backend is compiled into a build (see simdvec.h), so
+ * backends are compared across builds: pairs are sampled from a
+ * fixed seed, the same on every platform, so --msvdump/--vitdump from
+ * two builds dump the same calculations, and
+ *    kcheck --diff <dump1> <dump2>
+ * compares them cell by cell. Dumping needs a p7_DEBUGGING build.
+ */
+#include "p7_config.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer/src/hmmer.h"
+#include "hmmer/src/dp_vector/ssvfilter.h"
+#include "hmmer/src/dp_vector/msvfilter.h"
+#include "hmmer/src/dp_vector/vitfilter.h"
+#include "hmmer/src/dp_reference/p7_refmx.h"
+#include "hmmer/src/dp_reference/reference_viterbi.h"
+
+#if   defined(eslENABLE_AVX512)
+#define KCHECK_BACKEND "avx512"
+#elif defined(eslENABLE_AVX)
+#define KCHECK_BACKEND "avx"
+#elif defined(eslENABLE_SSE)
+#define KCHECK_BACKEND "sse"
+#elif defined(eslENABLE_NEON)
+#define KCHECK_BACKEND "neon"
+#else
+#define KCHECK_BACKEND "unknown"
+#endif
+
+static ESL_OPTIONS options[] = {
+  /* name           type       default  env  range     toggles reqs incomp             help                                          docgroup*/
+  { "-h",        eslARG_NONE,    FALSE, NULL, NULL,      NULL,  NULL, NULL,            "show brief help on version and usage",              0 },
+  { "-s",        eslARG_INT,      "42", NULL, NULL,      NULL,  NULL, NULL,            "set random number seed to <n>",                     0 },
+  { "-N",        eslARG_INT,     "200", NULL, "n>0",     NULL,  NULL, NULL,            "number of model/sequence pairs",                    0 },
+  { "-M",        eslARG_INT,     "400", NULL, "n>0",     NULL,  NULL, NULL,            "sample model lengths uniformly from 1..<n>",        0 },
+  { "-L",        eslARG_INT,     "400", NULL, "n>0",     NULL,  NULL, NULL,            "sample i.i.d. target lengths uniformly from 1..<n>",0 },
+  { "--fhom",    eslARG_REAL,    "0.5", NULL, "0<=x<=1", NULL,  NULL, NULL,            "fraction of targets emitted from the model",        0 },
+  { "--tol",     eslARG_REAL,  "0.001", NULL, "x>=0",    NULL,  NULL, NULL,            "max |filter - reference| score difference, nats",   0 },
+  { "--msvdump", eslARG_OUTFILE,  NULL, NULL, NULL,      NULL,  NULL, "--diff",        "dump MSV filter DP rows to file <f>",               0 },
+  { "--vitdump", eslARG_OUTFILE,  NULL, NULL, NULL,      NULL,  NULL, "--diff",        "dump Viterbi filter DP rows to file <f>",           0 },
+  { "--diff",    eslARG_NONE,    FALSE, NULL, NULL,      NULL,  NULL, NULL,            "compare two dump files <f1> <f2> cell by cell",     0 },
+  { "--dtol",    eslARG_INT,       "0", NULL, "n>=0",    NULL,"--diff",NULL,           "with --diff: max difference between two cells",     0 },
+  { "--show",    eslARG_INT,      "20", NULL, "n>=0",    NULL,  NULL, NULL,            "report at most <n> mismatches",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]\n  or:  kcheck --diff [-options] <dumpfile1> <dumpfile2>";
+static char banner[] = "differential check of the SSV, MSV and Viterbi filter kernels";
+
+enum kcheck_kernel_e { K_SSV, K_MSV, K_VIT, K_REF, K_NKERNELS };
+static char *kernelname[K_NKERNELS] = { "ssv", "msv", "vitfilter", "reference" };
+
+static int
+diff_dumps(ESL_GETOPTS *go)
+{
+  char    *f1 = esl_opt_GetArg(go, 1);
+  char    *f2 = esl_opt_GetArg(go, 2);
+  FILE    *afp, *bfp;
+  int64_t  ncells, ndiff;
+  int      status;
+
+  if ((afp = fopen(f1, "r")) == NULL) p7_Fail("Failed to open dump file %s", f1);
+  if ((bfp = fopen(f2, "r")) == NULL) p7_Fail("Failed to open dump file %s", f2);
+
+  status = p7_filtermx_CompareDumps(afp, bfp, esl_opt_GetInteger(go, "--dtol"), stdout, esl_opt_GetInteger(go, "--show"), &ncells, &ndiff);
+  if      (status == eslOK)      printf("# %" PRId64 " cells: all match\n", ncells);
+  else if (status == eslFAIL)    printf("# %" PRId64 " cells: %" PRId64 " mismatches\n", ncells, ndiff);
+  else if (status == eslEFORMAT) printf("# dumps can't be compared past the first %" PRId64 " cells\n", ncells);
+  else                           p7_Fail("dump comparison failed with code %d", status);
+
+  fclose(afp);
+  fclose(bfp);
+  return (status == eslOK ? 0 : 1);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, -1, argc, argv, banner, usage);
+  ESL_STOPWATCH  *w       = NULL;
+  ESL_RANDOMNESS *rng     = NULL;
+  ESL_ALPHABET   *abc     = NULL;
+  P7_BG          *bg      = NULL;
+  ESL_SQ         *sq      = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_PROFILE     *gmf     = NULL;
+  P7_PROFILE     *gvf     = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_FILTERMX    *fx      = NULL;
+  P7_REFMX       *rmx     = NULL;
+  FILE           *msvfp   = NULL;
+  FILE           *vitfp   = NULL;
+  int             N       = esl_opt_GetInteger(go, "-N");
+  int             Mmax    = esl_opt_GetInteger(go, "-M");
+  int             Lmax    = esl_opt_GetInteger(go, "-L");
+  double          fhom    = esl_opt_GetReal   (go, "--fhom");
+  float           tol     = esl_opt_GetReal   (go, "--tol");
+  int             maxshow = esl_opt_GetInteger(go, "--show");
+  double          tk[K_NKERNELS] = { 0. };
+  double          cells   = 0.;
+  float           ssc, msc, vsc, rmsc, rvsc;
+  float           maxdiff_msv = 0.;
+  float           maxdiff_vit = 0.;
+  int             is_hom;
+  int             n_ovfl  = 0;
+  int             nfail   = 0;
+  int             i, k, M, L;
+  int             mstatus, vstatus;
+  int             status;
+
+  if (esl_opt_GetBoolean(go, "--diff"))
+    {
+      if (esl_opt_ArgNumber(go) != 2) esl_fatal("Incorrect number of command line arguments.\n%s", usage);
+      status = diff_dumps(go);
+      esl_getopts_Destroy(go);
+      exit(status);
+    }
+  if (esl_opt_ArgNumber(go) != 0) esl_fatal("Incorrect number of command line arguments.\n%s", usage);
+
+#ifndef p7_DEBUGGING
+  if (esl_opt_IsOn(go, "--msvdump") || esl_opt_IsOn(go, "--vitdump"))
+    p7_Fail("--msvdump and --vitdump need a build with p7_DEBUGGING defined");
+#endif
+  if (esl_opt_IsOn(go, "--msvdump") && (msvfp = fopen(esl_opt_GetString(go, "--msvdump"), "w")) == NULL) p7_Fail("Failed to open %s for writing", esl_opt_GetString(go, "--msvdump"));
+  if (esl_opt_IsOn(go, "--vitdump") && (vitfp = fopen(esl_opt_GetString(go, "--vitdump"), "w")) == NULL) p7_Fail("Failed to open %s for writing", esl_opt_GetString(go, "--vitdump"));
+
+  w   = esl_stopwatch_Create();
+  rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  abc = esl_alphabet_Create(eslAMINO);
+  bg  = p7_bg_Create(abc);
+  sq  = esl_sq_CreateDigital(abc);
+  fx  = p7_filtermx_Create(100);
+  rmx = p7_refmx_Create(100, 100);
+
+  printf("# kcheck: %s backend, seed %d, %d pairs\n", KCHECK_BACKEND, esl_opt_GetInteger(go, "-s"), N);
+  for (i = 0; i < N; i++)
+    {
+      /* The pair: a model, then either a homolog from its core model,
+       * or an i.i.d. sequence. The profile is configured to the
+       * target's length, as the engine does.
+       */
+      M = 1 + esl_rnd_Roll(rng, Mmax);
+      if (p7_modelsample(rng, M, abc, &hmm) != eslOK) esl_fatal("failed to sample an HMM");
+
+      esl_sq_Reuse(sq);
+      is_hom = (esl_random(rng) < fhom);
+      if (is_hom)
+	{
+	  do {
+	    esl_sq_Reuse(sq);
+	    p7_CoreEmit(rng, hmm, sq, NULL);
+	  } while (sq->n == 0);
+	}
+      else
+	{
+	  L = 1 + esl_rnd_Roll(rng, Lmax);
+	  esl_sq_GrowTo(sq, L);
+	  esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq);
+	  sq->n = L;
+	}
+      L = (int) sq->n;
+
+      gm = p7_profile_Create (M, abc);
+      om = p7_oprofile_Create(M, abc);
+      p7_profile_ConfigLocal(gm, hmm, bg, L);
+      p7_oprofile_Convert(gm, om);
+      gmf = p7_profile_Clone(gm);
+      gvf = p7_profile_Clone(gm);
+      p7_profile_SameAsMF(om, gmf);
+      p7_profile_SameAsVF(om, gvf);
+      cells += (double) M * (double) L;
+
+      /* The kernels */
+      esl_stopwatch_Start(w);
+      p7_SSVFilter(sq->dsq, L, om, &ssc);
+      esl_stopwatch_Stop(w);
+      tk[K_SSV] += esl_stopwatch_GetElapsed(w);
+
+      if (msvfp) p7_filtermx_SetDumpMode(fx, msvfp, TRUE);
+      esl_stopwatch_Start(w);
+      mstatus = p7_MSVFilter(sq->dsq, L, om, fx, &msc);
+      esl_stopwatch_Stop(w);
+      tk[K_MSV] += esl_stopwatch_GetElapsed(w);
+      if (msvfp) p7_filtermx_SetDumpMode(fx, NULL, FALSE);
+      p7_filtermx_Reuse(fx);
+
+      if (vitfp) p7_filtermx_SetDumpMode(fx, vitfp, TRUE);
+      esl_stopwatch_Start(w);
+      vstatus = p7_ViterbiFilter(sq->dsq, L, om, fx, &vsc);
+      esl_stopwatch_Stop(w);
+      tk[K_VIT] += esl_stopwatch_GetElapsed(w);
+      if (vitfp) p7_filtermx_SetDumpMode(fx, NULL, FALSE);
+      p7_filtermx_Reuse(fx);
+
+      /* Reference scores, in each filter's units. The reference
+       * Viterbi on <gvf> is timed as the baseline.
+       */
+      p7_ReferenceViterbi(sq->dsq, L, gmf, rmx, NULL, &rmsc);
+      p7_refmx_Reuse(rmx);
+      rmsc = rmsc / om->scale_b - 3.0f;
+
+      esl_stopwatch_Start(w);
+      p7_ReferenceViterbi(sq->dsq, L, gvf, rmx, NULL, &rvsc);
+      esl_stopwatch_Stop(w);
+      tk[K_REF] += esl_stopwatch_GetElapsed(w);
+      p7_refmx_Reuse(rmx);
+      rvsc = rvsc / om->scale_w - 3.0f;
+
+      /* A filter that overflows returns eslERANGE and +inf: it only
+       * promises the score is high, so there's nothing to compare.
+       */
+      if (mstatus == eslERANGE || vstatus == eslERANGE) n_ovfl++;
+      if (mstatus != eslERANGE) maxdiff_msv = ESL_MAX(maxdiff_msv, fabsf(msc - rmsc));
+      if (vstatus != eslERANGE) maxdiff_vit = ESL_MAX(maxdiff_vit, fabsf(vsc - rvsc));
+      if ((mstatus != eslERANGE && fabsf(msc - rmsc) > tol) ||
+	  (vstatus != eslERANGE && fabsf(vsc - rvsc) > tol))
+	{
+	  if (nfail++ < maxshow)
+	    printf("pair %d (M=%d L=%d %s): ssv %.4f  msv %.4f ref %.4f  vit %.4f ref %.4f\n",
+		   i, M, L, (is_hom ? "homolog" : "iid"), ssc, msc, rmsc, vsc, rvsc);
+	}
+
+      p7_profile_Destroy(gvf);
+      p7_profile_Destroy(gmf);
+      p7_oprofile_Destroy(om);
+      p7_profile_Destroy(gm);
+      p7_hmm_Destroy(hmm);
+    }
+
+  printf("# %d pairs, %.0f cells; %d overflowed a filter and were only partly checked\n", N, cells, n_ovfl);
+  printf("# max |score - reference|: msv %.6f  vitfilter %.6f  (tolerance %g)\n", maxdiff_msv, maxdiff_vit, tol);
+  printf("# %-10s %10s %10s\n", "kernel", "sec", "Mcells/s");
+  for (k = 0; k < K_NKERNELS; k++)
+    printf("# %-10s %10.4f %10.1f\n", kernelname[k], tk[k], (tk[k] > 0. ? cells / tk[k] * 1e-6 : 0.));
+  printf("# %s\n", (nfail ? "FAIL" : "ok"));
+  if (nfail) printf("# %d pairs mismatched\n", nfail);
+
+  if (msvfp) fclose(msvfp);
+  if (vitfp) fclose(vitfp);
+  p7_refmx_Destroy(rmx);
+  p7_filtermx_Destroy(fx);
+  esl_sq_Destroy(sq);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_stopwatch_Destroy(w);
+  esl_getopts_Destroy(go);
+  exit(nfail ? 1 : 0);
+}
@@ -22,10 +22,12 @@
 #include "p7_hmmfile.h"	     /* P7_HMMFILE    : reading models from files                                                */
 #include "p7_hmmwindow.h"	     /* P7_HMM_WINDOW, P7_HMM_WINDOWLIST : {nhmmer}                                              */
 #include "p7_masstrace.h"	     /* P7_MASSTRACE  : workspace used in calculating envelope bounds for a domain               */  // DEPRECATED
+#include "p7_memgov.h"	     /* P7_MEMGOV     : process-wide memory budget for DP matrices, shared by a thread crew             */
 #include "p7_prior.h"	     /* P7_PRIOR      : Dirichlet mixture prior on model parameters                              */
 #include "p7_profile.h"	     /* P7_PROFILE    : search model, glocal/local, with additional states for nonhomologous seq */
 #include "p7_profile_mpi.h"     /*               :    ... add-on: MPI communication                                         */
 #include "p7_scoredata.h"	     /* P7_SCOREDATA  : {nhmmer}                                                                 */
+#include "p7_timeline.h"	     /* P7_TIMELINE   : per-thread event timeline, written as Chrome trace JSON                  */
 #include "p7_tophits.h"	     /* P7_HIT, P7_TOPHITS : accumulated information about hits (scores, alis) during search     */
 #include "p7_tophits_mpi.h"     /*               :    ... add-on: MPI communication                                         */
 #include "p7_trace.h"	     /* P7_TRACE      : alignment of a model to a sequence: an HMM state path                    */
@@ -4,12 +4,14 @@
  *    1. API for the P7_CHECKPTMX object
  *    2. Debugging, development routines.
  *    3. Internal routines.
- *    4. Copyright and license information.
+ *    4. Benchmark driver.
+ *    5. Copyright and license information.
  */
 #include "p7_config.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "easel.h"
 
@@ -200,7 +202,7 @@ p7_checkptmx_GrowTo(P7_CHECKPTMX *ox, int M, int L)
     }
 
   /* Does matrix dp_mem need reallocation, either up or down? */
-  maxR  = (int) (ox->nalloc / ox->allocW);                      /* max rows if we use up to the recommended allocation size.      */
+  maxR  = (int) (ox->ramlimit / ox->allocW);                    /* max rows if we use up to the recommended allocation size.      */
   if ( (ox->nalloc > ox->ramlimit && minR_chk <= maxR) ||       /* we were redlined, and recommended alloc will work: so downsize */
        minR_chk > ox->validR)				        /* not enough memory for needed rows: so upsize                   */
     {
@@ -292,6 +294,125 @@ p7_checkptmx_MinSizeof(int M, int L)
 }
 
 
+/* Function:  p7_checkptmx_PlanSizeof()
+ * Synopsis:  Predict the size of the matrix <_GrowTo()> will leave.
+ *
+ * Purpose:   Calculate and return the size, in bytes, that
+ *            checkpointed matrix <ox> will have after
+ *            <p7_checkptmx_GrowTo(ox, M, L)>, for a comparison of a
+ *            profile of length <M> to a sequence of length <L>.
+ *
+ *            This follows <_GrowTo()>'s decisions on the existing
+ *            allocation. If <ox> is already wide enough and has
+ *            enough rows for at least a checkpointed layout, it's
+ *            kept as is, even if a fresh layout would be smaller.
+ *            Rows only get wider, never narrower. Otherwise the
+ *            matrix is reallocated to a full layout if that fits in
+ *            <ox->ramlimit>, else a checkpointed one using every row
+ *            the limit allows, else a minimal fully checkpointed
+ *            ("redlined") one. The array of row pointers never
+ *            shrinks.
+ *
+ *            If <ox> is <NULL>, return the size of a new matrix laid
+ *            out under a recommended memory limit of <ramlimit>
+ *            bytes; <ramlimit> is ignored when <ox> is given.
+ *
+ *            Like <_MinSizeof()>, this doesn't change or allocate a
+ *            matrix. The engine uses it to reserve memory from a
+ *            <P7_MEMGOV> before growing its matrix.
+ */
+size_t
+p7_checkptmx_PlanSizeof(const P7_CHECKPTMX *ox, int M, int L, int64_t ramlimit)
+{
+  int64_t W      = sizeof(float) * P7_NVF(M) * p7C_NSCELLS * p7_VNF + ESL_UPROUND(sizeof(float) * p7C_NXCELLS, p7_VALIGN); // row width; see _GrowTo()
+  int64_t R0     = 3;                                          // fwd[0]; bck[prv,cur]
+  int64_t minR   = R0 + (int) ceil(minimum_rows(L));
+  int64_t allocW = 0;         // what <ox> holds now, if anything
+  int64_t nalloc = 0;
+  int64_t validR = 0;
+  int64_t allocR = 0;
+  int64_t maxR;
+  size_t  n      = sizeof(P7_CHECKPTMX);
+
+  if (ox)
+    {
+      ramlimit = ox->ramlimit;
+      allocW   = ox->allocW;
+      nalloc   = ox->nalloc;
+      validR   = ox->validR;
+      allocR   = ox->allocR;
+
+      /* _GrowTo() keeps the current allocation */
+      if (W <= allocW && nalloc <= ramlimit && minR <= validR)
+	return p7_checkptmx_Sizeof(ox);
+
+      if (W > allocW) { allocW = W; validR = nalloc / allocW; }
+    }
+  else allocW = W;
+
+  /* _GrowTo() reallocates dp_mem up or down, to set_row_layout()'s rows */
+  maxR = ramlimit / allocW;
+  if ( (nalloc > ramlimit && minR <= maxR) || minR > validR)
+    {
+      validR = (R0 + L <= maxR ? R0 + L : ESL_MAX(minR, maxR));
+      nalloc = validR * allocW;
+    }
+  allocR = ESL_MAX(allocR, validR);
+
+  n += p7_VALIGN-1;               // dp_mem is hand-aligned
+  n += nalloc;                    // dp_mem
+  n += allocR * sizeof(float *);  // dpf[] row ptrs
+  return n;
+}
+
+
+/* Function:  p7_checkptmx_CacheRamlimit()
+ * Synopsis:  Suggest a <ramlimit> that keeps the matrix in cache.
+ *
+ * Purpose:   Return a recommended <ramlimit>, in bytes, for a
+ *            <P7_CHECKPTMX> that is to stay resident in this
+ *            thread's share of the CPU cache, when <nthreads> threads
+ *            are each running their own DP. This is the larger of
+ *            the per-core L2 size and an equal share of the L3,
+ *            as reported by <sysconf()>. If the cache sizes can't
+ *            be determined, <p7_CHECKPTMX_L2_DEFAULT> is used for L2
+ *            and L3 is ignored.
+ *
+ *            With the default <p7_SPARSIFY_RAMLIMIT> of 128 MiB,
+ *            typical comparisons get a full (uncheckpointed) matrix
+ *            that is far bigger than L2. Using this smaller limit
+ *            instead makes <p7_checkptmx_GrowTo()> choose a
+ *            checkpointed layout sooner, trading Forward row
+ *            recomputation during the Backward pass for cache
+ *            residency. Whether that's a win depends on <M> and <L>;
+ *            the benchmark driver in this file measures the
+ *            crossover.
+ *
+ * Args:      nthreads - number of threads sharing the L3 (>=1)
+ *
+ * Returns:   recommended <ramlimit>, in bytes.
+ */
+int64_t
+p7_checkptmx_CacheRamlimit(int nthreads)
+{
+  long    l2 = -1;
+  long    l3 = -1;
+  int64_t share;
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+  if (l2 <= 0)      l2 = p7_CHECKPTMX_L2_DEFAULT;
+  if (nthreads < 1) nthreads = 1;
+
+  share = (l3 > 0 ? (int64_t) l3 / nthreads : 0);
+  return ESL_MAX((int64_t) l2, share);
+}
+
+
 /* Function:  p7_checkptmx_Reuse()
  * Synopsis:  Recycle a checkpointed vector DP matrix.
  *
@@ -656,6 +777,142 @@ checkpointed_rows(int L, int R)
 /*----------------- end, internals ------------------------------*/
 
 
+/*****************************************************************
+ * 4. Benchmark driver
+ *****************************************************************/
+#ifdef p7CHECKPTMX_BENCHMARK
+/* 
+   gcc -O2 -Wall -msse2 -std=gnu99 -o p7_checkptmx_benchmark -I. -L. -I../easel -L../easel -Dp7CHECKPTMX_BENCHMARK p7_checkptmx.c -lhmmer -leasel -lm
+   ./p7_checkptmx_benchmark
+
+   For each model length M in a sweep from 50 to 2000, times the
+   checkpointed Forward/Backward filters on <N> random sequences of
+   length <L>, with the matrix sized by the default RAM limit and
+   by the per-thread cache limit from p7_checkptmx_CacheRamlimit().
+   Output is one tab-delimited line per M:
+      M  L  default_sec  default_Ra  default_Rbc  cache_sec  cache_Ra  cache_Rbc
+   where Ra is the number of uncheckpointed rows, and Rbc the number of
+   checkpoints. The crossover is where cache_sec drops below default_sec.
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "dp_vector/fwdfilter.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,      "0", NULL, NULL,      NULL,      NULL,    NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0",     NULL,      NULL,    NULL, "length of random target seqs",                   0 },
+  { "-N",        eslARG_INT,    "200", NULL, "n>0",     NULL,      NULL,    NULL, "number of random target seqs",                   0 },
+  { "-t",        eslARG_INT,      "1", NULL, "n>0",     NULL,      NULL,    NULL, "number of threads sharing L3, for cache limit",  0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark of P7_CHECKPTMX layouts: RAM limit vs. cache limit";
+
+static double
+time_fb(ESL_STOPWATCH *w, ESL_DSQ **dsq, int N, int L, P7_OPROFILE *om, P7_CHECKPTMX *cx, P7_SPARSEMASK *sm)
+{
+  float fsc;
+  int   i;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      p7_ForwardFilter (dsq[i], L, om, cx, &fsc);
+      p7_BackwardFilter(dsq[i], L, om, cx, sm, p7_SPARSIFY_THRESH);
+      p7_checkptmx_Reuse(cx);
+      p7_sparsemask_Reuse(sm);
+    }
+  esl_stopwatch_Stop(w);
+  return esl_stopwatch_GetElapsed(w);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *rng     = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg      = p7_bg_Create(abc);
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  int64_t         cachelim= p7_checkptmx_CacheRamlimit(esl_opt_GetInteger(go, "-t"));
+  int             Mlist[] = { 50, 100, 200, 400, 600, 800, 1000, 1500, 2000 };
+  int             nM      = sizeof(Mlist) / sizeof(int);
+  ESL_DSQ       **dsq     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_CHECKPTMX   *cx1     = NULL;
+  P7_CHECKPTMX   *cx2     = NULL;
+  P7_SPARSEMASK  *sm      = NULL;
+  double          t1, t2;
+  int             i, m, M;
+  int             status;
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ *) * N);
+  for (i = 0; i < N; i++)
+    {
+      ESL_ALLOC(dsq[i], sizeof(ESL_DSQ) * (L+2));
+      esl_rsq_xfIID(rng, bg->f, abc->K, L, dsq[i]);
+    }
+
+  printf("# cache limit: %" PRId64 " bytes\n", cachelim);
+  printf("# M\tL\tdefault_sec\tdefault_Ra\tdefault_Rbc\tcache_sec\tcache_Ra\tcache_Rbc\n");
+  for (m = 0; m < nM; m++)
+    {
+      M = Mlist[m];
+      if (p7_modelsample(rng, M, abc, &hmm) != eslOK) esl_fatal("failed to sample an HMM");
+      gm = p7_profile_Create (M, abc);
+      om = p7_oprofile_Create(M, abc);
+      p7_profile_Config(gm, hmm, bg);
+      p7_oprofile_Convert(gm, om);
+      p7_oprofile_ReconfigLength(om, L);
+
+      cx1 = p7_checkptmx_Create(M, L, ESL_MBYTES(p7_SPARSIFY_RAMLIMIT));
+      cx2 = p7_checkptmx_Create(M, L, cachelim);
+      sm  = p7_sparsemask_Create(M, L);
+
+      t1 = time_fb(w, dsq, N, L, om, cx1, sm);
+      t2 = time_fb(w, dsq, N, L, om, cx2, sm);
+
+      printf("%d\t%d\t%.4f\t%d\t%d\t%.4f\t%d\t%d\n",
+	     M, L, t1, cx1->Ra, cx1->Rb + cx1->Rc, t2, cx2->Ra, cx2->Rb + cx2->Rc);
+
+      p7_sparsemask_Destroy(sm);
+      p7_checkptmx_Destroy(cx2);
+      p7_checkptmx_Destroy(cx1);
+      p7_oprofile_Destroy(om);
+      p7_profile_Destroy(gm);
+      p7_hmm_Destroy(hmm);
+    }
+
+  for (i = 0; i < N; i++) free(dsq[i]);
+  free(dsq);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_stopwatch_Destroy(w);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ ERROR:
+  esl_fatal("allocation failed");
+}
+#endif /*p7CHECKPTMX_BENCHMARK*/
+/*------------------ end, benchmark -----------------------------*/
+
+
 /*****************************************************************
  * @LICENSE@
  *
@@ -91,6 +91,8 @@ extern P7_CHECKPTMX *p7_checkptmx_Create   (int M, int L, int64_t ramlimit);
 extern int           p7_checkptmx_GrowTo   (P7_CHECKPTMX *ox, int M, int L);
 extern size_t        p7_checkptmx_Sizeof   (const P7_CHECKPTMX *ox);
 extern size_t        p7_checkptmx_MinSizeof(int M, int L);
+extern size_t        p7_checkptmx_PlanSizeof(const P7_CHECKPTMX *ox, int M, int L, int64_t ramlimit);
+extern int64_t       p7_checkptmx_CacheRamlimit(int nthreads);
 extern int           p7_checkptmx_Reuse    (P7_CHECKPTMX *ox);
 extern void          p7_checkptmx_Destroy  (P7_CHECKPTMX *ox);
 
@@ -28,6 +28,10 @@
 /* Sparsification in checkpointed/vectorized local decoding: fwdfilter.c */
 #define p7_SPARSIFY_RAMLIMIT      128  // Memory "redline" cap on the O(M sqrt L) checkpoint mx
 #define p7_SPARSIFY_THRESH       0.01  // per-cell posterior probability inclusion threshold 
+#define p7_SPARSIFY_MAXCELLS        0  // >0: raise the threshold until sparse mask has <= this many cells. 0=unlimited
+#define p7_SPARSIFY_MAXROW          0  // >0: ... and no row has more than this many. 0=unlimited
+#define p7_SPARSIFY_THRESH_MAX    0.5  // never raise the threshold past this, whether or not the budget is met
+#define p7_CHECKPTMX_L2_DEFAULT  (1024*1024)  // assumed L2 size in bytes, if sysconf() can't tell us; see p7_checkptmx_CacheRamlimit()
 
 /* MPAS algorithm: {reference,sparse}_anchors.c */
 #define p7_MPAS_LOSS_THRESHOLD  0.001  // Controls main convergence criterion
@@ -39,6 +43,9 @@
 #define p7_ENGINE_FIXED_SEED       42  // if 0, RNG is seeded randomly
 #define p7_ENGINE_REPRODUCIBLE   TRUE  // TRUE reseeds RNG for every comparison, making results order-independent
 #define p7_ENGINE_DO_BIASFILTER  TRUE  // Use ad hoc "bias filter" after MSV/SSV step
+#define p7_ENGINE_CACHE_NTHREADS    0  // >0: size checkpoint mx to this many threads' share of L2/L3, not p7_SPARSIFY_RAMLIMIT
+#define p7_ENGINE_WINDOW_OVERLAP  0.5  // Merge SSV windows on long targets if overlap/shorter window length exceeds this
+#define p7_ENGINE_MAIN_MODE         0  // How far the main engine goes: 0=alignments; 1=scores only; 2=scores+envelopes. [p7E_FULL etc, p7_engine.h]
 
 #define p7_SEQDBENV          "BLASTDB"
 #define p7_HMMDBENV          "PFAMDB"
@@ -1,21 +1,41 @@
 #include "p7_config.h"
 
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* The filter and main engine pipelines, p7_engine_Overthruster(),
+ * p7_engine_Main() and p7_engine_FindWindows(), call DP kernels in
+ * dp_vector/ and dp_sparse/ that this source tree doesn't carry. They
+ * are only compiled with p7_ENGINE_KERNELS defined, against a full
+ * HMMER tree; without it, this file provides the engine's parameters,
+ * statistics, and DP structure management.
+ */
+#ifdef p7_ENGINE_KERNELS
 /* SIMD-vectorized acceleration filters, local only: */
-//#include "dp_vector/msvfilter.h"          // MSV/SSV primary acceleration filter
-//#include "dp_vector/vitfilter.h"          // Viterbi secondary acceleration filter
-//#include "dp_vector/fwdfilter.h"          // Sparsification w/ checkpointed local Forward/Backward
+#include "dp_vector/msvfilter.h"          // MSV/SSV primary acceleration filter
+#include "dp_vector/vitfilter.h"          // Viterbi secondary acceleration filter
+#include "dp_vector/fwdfilter.h"          // Sparsification w/ checkpointed local Forward/Backward
 
 /* Sparse DP, dual-mode glocal/local:    */
-//#include "dp_sparse/sparse_fwdback.h"     // sparse Forward/Backward
-//#include "dp_sparse/sparse_viterbi.h"     // sparse Viterbi
-//#include "dp_sparse/sparse_decoding.h"    // sparse Decoding
-//#include "dp_sparse/sparse_anchors.h"     // most probable anchor set (MPAS) 
+#include "dp_sparse/sparse_fwdback.h"     // sparse Forward/Backward
+#include "dp_sparse/sparse_viterbi.h"     // sparse Viterbi
+#include "dp_sparse/sparse_decoding.h"    // sparse Decoding
+#include "dp_sparse/sparse_anchors.h"     // most probable anchor set (MPAS) 
 
 /* Sparse anchor-set-constrained (ASC): */
-//#include "dp_sparse/sparse_asc_fwdback.h"   // ASC Forward/Backward
-//#include "dp_sparse/sparse_envelopes.h"     // Envelope inference
-//#include "dp_sparse/sparse_null2.h"         // Null2 score correction
-//#include "dp_sparse/sparse_aec_align.h"     // anchor/envelope constrained alignment
+#include "dp_sparse/sparse_asc_fwdback.h"   // ASC Forward/Backward
+#include "dp_sparse/sparse_envelopes.h"     // Envelope inference
+#include "dp_sparse/sparse_null2.h"         // Null2 score correction
+#include "dp_sparse/sparse_aec_align.h"     // anchor/envelope constrained alignment
+#endif /*p7_ENGINE_KERNELS*/
 
 #include "p7_engine.h"  // FIXME: we'll move the engine somewhere else, I think
 
@@ -39,8 +59,16 @@ p7_engine_params_Create(P7_MPAS_PARAMS *mpas_params)
   prm->rng_seed          = p7_ENGINE_FIXED_SEED;     // Defaults are set in p7_config.h.in
   prm->rng_reproducible  = p7_ENGINE_REPRODUCIBLE; 
   prm->sparsify_ramlimit = p7_SPARSIFY_RAMLIMIT;     
+  prm->cache_nthreads    = p7_ENGINE_CACHE_NTHREADS;
   prm->sparsify_thresh   = p7_SPARSIFY_THRESH;   
+  prm->sparsify_maxcells = p7_SPARSIFY_MAXCELLS;
+  prm->sparsify_maxrow   = p7_SPARSIFY_MAXROW;
   prm->do_biasfilter     = p7_ENGINE_DO_BIASFILTER;
+  prm->main_mode         = p7_ENGINE_MAIN_MODE;
+  prm->do_timing         = FALSE;
+  prm->do_counters       = FALSE;
+  prm->do_memory         = FALSE;
+  prm->do_latency        = FALSE;
   prm->mpas_params       = (mpas_params ? mpas_params : NULL);
   return prm;
 
@@ -63,18 +91,81 @@ p7_engine_params_Destroy(P7_ENGINE_PARAMS *prm)
  * 2. P7_ENGINE_STATS
  *****************************************************************/ 
 
+static const char *engine_stagename[p7E_NSTAGES] = { "null", "msv", "bias", "vit", "fwd", "bck", "sparse_vit", "sparse_fwd",
+						     "sparse_bck", "sparse_dec", "anchors", "asc", "envelopes", "null2", "aec" };
+
+static int      engine_latbin    (uint64_t ns);
+static uint64_t engine_latbin_lo (int b);
+static void     engine_slowinsert(P7_ENGINE_STATS *stats, const P7_ENGINE_SLOWSEQ *sl);
+
 P7_ENGINE_STATS *
 p7_engine_stats_Create(void)
 {
   P7_ENGINE_STATS *stats = NULL;
+  int              s, c;
   int              status;
 
   ESL_ALLOC(stats, sizeof(P7_ENGINE_STATS));
-  stats->n_past_msv  = 0;
-  stats->n_past_bias = 0;
-  stats->n_ran_vit   = 0;
-  stats->n_past_vit  = 0;
-  stats->n_past_fwd  = 0;
+  stats->n_seqs        = 0;
+  stats->n_past_msv    = 0;
+  stats->n_past_bias   = 0;
+  stats->n_ran_vit     = 0;
+  stats->n_f2_shortcut = 0;
+  stats->n_past_vit    = 0;
+  stats->n_past_fwd    = 0;
+
+  stats->res_seqs      = 0;
+  stats->res_past_msv  = 0;
+  stats->res_past_bias = 0;
+  stats->res_past_vit  = 0;
+  stats->res_past_fwd  = 0;
+
+  for (s = 0; s < p7E_NDENSBINS; s++) stats->density_hist[s] = 0;
+
+  stats->n_main = 0;
+  stats->n_hits = 0;
+
+  stats->n_mpas_fastpath = 0;
+  stats->n_mpas_sampled  = 0;
+  p7_mpas_stats_Init(&(stats->mpas));
+
+  stats->n_mem_fallback  = 0;
+  stats->n_mem_deferred  = 0;
+
+  stats->n_sparsify_raised      = 0;
+  stats->sparsify_cells_dropped = 0;
+  stats->sparsify_lost          = 0.;
+
+  for (s = 0; s < p7E_NSTAGES; s++)
+    {
+      stats->stage_ns[s]    = 0;
+      stats->stage_calls[s] = 0;
+      stats->stage_res[s]   = 0;
+      for (c = 0; c < p7E_NCTRS; c++) stats->stage_ctr[s][c] = 0;
+    }
+
+  for (c = 0; c < p7E_NCTRS; c++) stats->ctr_avail[c] = FALSE;
+
+  for (s = 0; s < p7E_NMEM; s++)
+    {
+      stats->mem_cur[s]         = 0;
+      stats->mem_peak[s]        = 0;
+      stats->mem_peak_L[s]      = 0;
+      stats->mem_peak_M[s]      = 0;
+      stats->mem_peak_ncells[s] = 0;
+      stats->mem_ngrow[s]       = 0;
+    }
+  stats->mem_total_peak        = 0;
+  stats->mem_total_peak_L      = 0;
+  stats->mem_total_peak_M      = 0;
+  stats->mem_total_peak_ncells = 0;
+  stats->sm_krealloc = stats->sm_rrealloc = stats->sm_srealloc = 0;
+
+  for (s = 0; s < p7E_NLATBINS; s++) stats->lat_hist[s] = 0;
+  stats->lat_n          = 0;
+  stats->lat_total      = 0;
+  stats->lat_max        = 0;
+  stats->nslow          = 0;
   return stats;
 
  ERROR:
@@ -82,10 +173,388 @@ p7_engine_stats_Create(void)
   return NULL;
 }
 
+/* Function:  p7_engine_stats_Merge()
+ * Synopsis:  Add one engine's statistics into another's.
+ *
+ * Purpose:   Add the counters and stage timings in <src> to <dst>;
+ *            for example, to aggregate the per-thread engine stats
+ *            of a threaded search into one report. The per-comparison
+ *            <mpas> stats of <dst> are left alone.
+ *
+ *            Memory sizes and growth counts are summed, so <mem_cur>
+ *            is what all the engines hold together. Peaks, and the
+ *            comparisons that set them, are the largest of any one
+ *            engine's.
+ *
+ *            Latency histograms are summed, and the slowest
+ *            comparisons of <src> are merged into those of <dst>,
+ *            keeping the slowest <p7E_NSLOW> of both.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_engine_stats_Merge(P7_ENGINE_STATS *dst, const P7_ENGINE_STATS *src)
+{
+  int s, c;
+
+  dst->n_seqs          += src->n_seqs;
+  dst->n_past_msv      += src->n_past_msv;
+  dst->n_past_bias     += src->n_past_bias;
+  dst->n_ran_vit       += src->n_ran_vit;
+  dst->n_f2_shortcut   += src->n_f2_shortcut;
+  dst->n_past_vit      += src->n_past_vit;
+  dst->n_past_fwd      += src->n_past_fwd;
+  dst->res_seqs        += src->res_seqs;
+  dst->res_past_msv    += src->res_past_msv;
+  dst->res_past_bias   += src->res_past_bias;
+  dst->res_past_vit    += src->res_past_vit;
+  dst->res_past_fwd    += src->res_past_fwd;
+  dst->n_main          += src->n_main;
+  dst->n_hits          += src->n_hits;
+  dst->n_mpas_fastpath += src->n_mpas_fastpath;
+  dst->n_mpas_sampled  += src->n_mpas_sampled;
+  dst->n_mem_fallback  += src->n_mem_fallback;
+  dst->n_mem_deferred  += src->n_mem_deferred;
+
+  dst->n_sparsify_raised      += src->n_sparsify_raised;
+  dst->sparsify_cells_dropped += src->sparsify_cells_dropped;
+  dst->sparsify_lost          += src->sparsify_lost;
+
+  for (s = 0; s < p7E_NDENSBINS; s++)
+    dst->density_hist[s] += src->density_hist[s];
+
+  for (s = 0; s < p7E_NSTAGES; s++)
+    {
+      dst->stage_ns[s]    += src->stage_ns[s];
+      dst->stage_calls[s] += src->stage_calls[s];
+      dst->stage_res[s]   += src->stage_res[s];
+      for (c = 0; c < p7E_NCTRS; c++) dst->stage_ctr[s][c] += src->stage_ctr[s][c];
+    }
+  for (c = 0; c < p7E_NCTRS; c++)
+    if (src->ctr_avail[c]) dst->ctr_avail[c] = TRUE;
+
+  for (s = 0; s < p7E_NMEM; s++)
+    {
+      dst->mem_cur[s]   += src->mem_cur[s];
+      dst->mem_ngrow[s] += src->mem_ngrow[s];
+      if (src->mem_peak[s] > dst->mem_peak[s])
+	{
+	  dst->mem_peak[s]        = src->mem_peak[s];
+	  dst->mem_peak_L[s]      = src->mem_peak_L[s];
+	  dst->mem_peak_M[s]      = src->mem_peak_M[s];
+	  dst->mem_peak_ncells[s] = src->mem_peak_ncells[s];
+	}
+    }
+  if (src->mem_total_peak > dst->mem_total_peak)
+    {
+      dst->mem_total_peak        = src->mem_total_peak;
+      dst->mem_total_peak_L      = src->mem_total_peak_L;
+      dst->mem_total_peak_M      = src->mem_total_peak_M;
+      dst->mem_total_peak_ncells = src->mem_total_peak_ncells;
+    }
+  dst->sm_krealloc    += src->sm_krealloc;
+  dst->sm_rrealloc    += src->sm_rrealloc;
+  dst->sm_srealloc    += src->sm_srealloc;
+
+  for (s = 0; s < p7E_NLATBINS; s++) dst->lat_hist[s] += src->lat_hist[s];
+  dst->lat_n     += src->lat_n;
+  dst->lat_total += src->lat_total;
+  dst->lat_max    = ESL_MAX(dst->lat_max, src->lat_max);
+  for (s = 0; s < src->nslow; s++) engine_slowinsert(dst, &(src->slow[s]));
+  return eslOK;
+}
+
+
+/* Function:  p7_engine_stats_Dump()
+ * Synopsis:  Print engine statistics.
+ *
+ * Purpose:   Print the filter funnel in <stats> to <ofp>: the number
+ *            and fraction of comparisons, and of their residues,
+ *            that passed each filter; how many skipped the Viterbi
+ *            filter on the F2 shortcut; and a histogram of sparse
+ *            mask density ncells/(L*M). Then the other counters;
+ *            then, if any stage was timed, a table of calls,
+ *            residues, total time, and ns/residue for each stage,
+ *            and the main engine's time per call and per hit; then, if hardware counters were
+ *            collected, a table of cycles, instructions per cycle,
+ *            and cache and branch misses per residue for each
+ *            stage. Counters that couldn't be opened show as "-".
+ */
+int
+p7_engine_stats_Dump(FILE *ofp, const P7_ENGINE_STATS *stats)
+{
+  static char *ctrname[p7E_NCTRS] = { "cycles", "instr", "L1D_miss", "LLC_miss", "br_miss" };
+  double nseq = (stats->n_seqs   ? (double) stats->n_seqs   : 1.);
+  double nres = (stats->res_seqs ? (double) stats->res_seqs : 1.);
+  int64_t main_ns;
+  int s, c;
+
+  fprintf(ofp, "# %-20s %14s %8s %16s %8s\n", "filter funnel", "seqs", "frac", "residues", "frac");
+  fprintf(ofp, "# %-20s %14s %8s %16s %8s\n", "--------------------", "--------------", "--------", "----------------", "--------");
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f %16" PRId64 " %8.4f\n", "compared",     stats->n_seqs,      stats->n_seqs      / nseq, stats->res_seqs,      stats->res_seqs      / nres);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f %16" PRId64 " %8.4f\n", "past MSV",     stats->n_past_msv,  stats->n_past_msv  / nseq, stats->res_past_msv,  stats->res_past_msv  / nres);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f %16" PRId64 " %8.4f\n", "past bias",    stats->n_past_bias, stats->n_past_bias / nseq, stats->res_past_bias, stats->res_past_bias / nres);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f\n",                     "ran Viterbi",  stats->n_ran_vit,   stats->n_ran_vit   / nseq);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f\n",                     "F2 shortcut",  stats->n_f2_shortcut, stats->n_f2_shortcut / nseq);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f %16" PRId64 " %8.4f\n", "past Viterbi", stats->n_past_vit,  stats->n_past_vit  / nseq, stats->res_past_vit,  stats->res_past_vit  / nres);
+  fprintf(ofp, "  %-20s %14" PRId64 " %8.4f %16" PRId64 " %8.4f\n", "past Forward", stats->n_past_fwd,  stats->n_past_fwd  / nseq, stats->res_past_fwd,  stats->res_past_fwd  / nres);
+  fprintf(ofp, "  %-20s %14" PRId64 "\n",                           "main engine",  stats->n_main);
+  fprintf(ofp, "  %-20s %14" PRId64 "\n",                           "hits stored",  stats->n_hits);
+
+  if (stats->n_past_fwd)
+    {
+      fprintf(ofp, "# %-20s %14s %8s\n", "sparse mask density", "seqs", "frac");
+      fprintf(ofp, "  %-20s %14" PRId64 " %8.4f\n", "< 1e-05", stats->density_hist[0], (double) stats->density_hist[0] / (double) stats->n_past_fwd);
+      for (s = 1; s < p7E_NDENSBINS; s++)
+	fprintf(ofp, "  %8.2g - %-9.2g %14" PRId64 " %8.4f\n", pow(10., (double) (s-11) / 2.), pow(10., (double) (s-10) / 2.),
+		stats->density_hist[s], (double) stats->density_hist[s] / (double) stats->n_past_fwd);
+    }
+
+  fprintf(ofp, "# MPAS fast path:     %" PRId64 "\n", stats->n_mpas_fastpath);
+  fprintf(ofp, "# MPAS sampled:       %" PRId64 "\n", stats->n_mpas_sampled);
+  fprintf(ofp, "# memory fallbacks:   %" PRId64 "\n", stats->n_mem_fallback);
+  fprintf(ofp, "# memory deferrals:   %" PRId64 "\n", stats->n_mem_deferred);
+  fprintf(ofp, "# sparsify raised:    %" PRId64 " (%" PRId64 " cells dropped; upper bound on lost mass: %.4g)\n",
+	  stats->n_sparsify_raised, stats->sparsify_cells_dropped, stats->sparsify_lost);
+
+  for (s = 0; s < p7E_NSTAGES; s++)
+    if (stats->stage_calls[s]) break;
+  if (s == p7E_NSTAGES) return eslOK;
+
+  fprintf(ofp, "# %-12s %12s %14s %12s %10s\n", "stage", "calls", "residues", "seconds", "ns/res");
+  fprintf(ofp, "# %-12s %12s %14s %12s %10s\n", "------------", "------------", "--------------", "------------", "----------");
+  for (s = 0; s < p7E_NSTAGES; s++)
+    fprintf(ofp, "  %-12s %12" PRId64 " %14" PRId64 " %12.4f %10.2f\n",
+	    engine_stagename[s], stats->stage_calls[s], stats->stage_res[s], (double) stats->stage_ns[s] * 1e-9,
+	    (stats->stage_res[s] ? (double) stats->stage_ns[s] / (double) stats->stage_res[s] : 0.));
+
+  for (main_ns = 0, s = p7E_ST_SVIT; s <= p7E_ST_AEC; s++) main_ns += stats->stage_ns[s];
+  fprintf(ofp, "# main engine:        %.4f sec; %.4f ms/comparison; %.4f ms/hit\n", (double) main_ns * 1e-9,
+	  (stats->n_main ? (double) main_ns * 1e-6 / (double) stats->n_main : 0.),
+	  (stats->n_hits ? (double) main_ns * 1e-6 / (double) stats->n_hits : 0.));
+
+  for (c = 0; c < p7E_NCTRS; c++)
+    if (stats->ctr_avail[c]) break;
+  if (c == p7E_NCTRS) return eslOK;
+
+  fprintf(ofp, "# %-12s %16s %6s", "stage", "cycles", "IPC");
+  for (c = 0; c < p7E_NCTRS; c++) fprintf(ofp, " %10s", ctrname[c]);
+  fprintf(ofp, "\n# %-12s %16s %6s", "", "", "");
+  for (c = 0; c < p7E_NCTRS; c++) fprintf(ofp, " %10s", "per res");
+  fprintf(ofp, "\n");
+  for (s = 0; s < p7E_NSTAGES; s++)
+    {
+      fprintf(ofp, "  %-12s %16" PRIu64, engine_stagename[s], stats->stage_ctr[s][p7E_CTR_CYCLES]);
+      if (stats->ctr_avail[p7E_CTR_INSTR] && stats->stage_ctr[s][p7E_CTR_CYCLES])
+	fprintf(ofp, " %6.2f", (double) stats->stage_ctr[s][p7E_CTR_INSTR] / (double) stats->stage_ctr[s][p7E_CTR_CYCLES]);
+      else
+	fprintf(ofp, " %6s", "-");
+      for (c = 0; c < p7E_NCTRS; c++)
+	{
+	  if (stats->ctr_avail[c] && stats->stage_res[s])
+	    fprintf(ofp, " %10.3f", (double) stats->stage_ctr[s][c] / (double) stats->stage_res[s]);
+	  else
+	    fprintf(ofp, " %10s", "-");
+	}
+      fprintf(ofp, "\n");
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_engine_stats_DumpMemory()
+ * Synopsis:  Print engine memory use.
+ *
+ * Purpose:   For an engine that sampled memory use (its params'
+ *            <do_memory>), print to <ofp> a table of the bytes each
+ *            DP structure held at the end of the last comparison,
+ *            its high-water mark and
+ *            the comparison (L, M, sparse mask cells) that set it,
+ *            and how many comparisons grew it; then the same for
+ *            all of them together, and the sparse mask's own
+ *            reallocation counts.
+ */
+int
+p7_engine_stats_DumpMemory(FILE *ofp, const P7_ENGINE_STATS *stats)
+{
+  static char *memname[p7E_NMEM] = { "filtermx", "checkptmx", "sparsemask", "sparsemx_f", "sparsemx_d", "asc_f", "asc_d", "anchorhash" };
+  int64_t cur = 0;
+  int     s;
+
+  fprintf(ofp, "# %-12s %10s %10s %10s %6s %12s %10s\n", "structure", "cur MB", "peak MB", "peak L", "M", "ncells", "grows");
+  fprintf(ofp, "# %-12s %10s %10s %10s %6s %12s %10s\n", "------------", "----------", "----------", "----------", "------", "------------", "----------");
+  for (s = 0; s < p7E_NMEM; s++)
+    {
+      fprintf(ofp, "  %-12s %10.2f %10.2f %10d %6d %12" PRId64 " %10" PRId64 "\n", memname[s],
+	      (double) stats->mem_cur[s] / 1048576., (double) stats->mem_peak[s] / 1048576.,
+	      stats->mem_peak_L[s], stats->mem_peak_M[s], stats->mem_peak_ncells[s], stats->mem_ngrow[s]);
+      cur += stats->mem_cur[s];
+    }
+  fprintf(ofp, "  %-12s %10.2f %10.2f %10d %6d %12" PRId64 "\n", "total",
+	  (double) cur / 1048576., (double) stats->mem_total_peak / 1048576.,
+	  stats->mem_total_peak_L, stats->mem_total_peak_M, stats->mem_total_peak_ncells);
+  fprintf(ofp, "# sparse mask reallocations: %" PRId64 " kmem, %" PRId64 " rows, %" PRId64 " seg\n",
+	  stats->sm_krealloc, stats->sm_rrealloc, stats->sm_srealloc);
+  return eslOK;
+}
+
+
+/* engine_slowcmp()
+ * qsort() comparison: slowest first.
+ */
+static int
+engine_slowcmp(const void *a, const void *b)
+{
+  uint64_t na = ((const P7_ENGINE_SLOWSEQ *) a)->ns;
+  uint64_t nb = ((const P7_ENGINE_SLOWSEQ *) b)->ns;
+  return (na < nb ? 1 : (na > nb ? -1 : 0));
+}
+
+/* Function:  p7_engine_stats_DumpLatency()
+ * Synopsis:  Print the latency distribution and the slowest comparisons.
+ *
+ * Purpose:   For an engine that recorded latencies (its params'
+ *            <do_latency>), print to <ofp> the number of
+ *            comparisons, their mean and maximum time, and percentiles from the latency histogram; then
+ *            the occupied histogram buckets with cumulative
+ *            fractions; then the slowest comparisons, slowest first,
+ *            with the stage each one reached, its sparse mask cells,
+ *            and its MPAS iterations ("-" if it didn't get to MPAS).
+ *
+ *            Percentiles are the upper edge of the bucket they fall
+ *            in, so they're within 12.5% above the true value.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_engine_stats_DumpLatency(FILE *ofp, const P7_ENGINE_STATS *stats)
+{
+  static double  pct[]  = { 0.5, 0.9, 0.99, 0.999, 0.9999 };
+  int            npct   = sizeof(pct) / sizeof(double);
+  P7_ENGINE_SLOWSEQ *sl = NULL;
+  int64_t        cum;
+  int            b, p;
+  int            status;
+
+  fprintf(ofp, "# comparisons:        %" PRId64 "\n", stats->lat_n);
+  if (! stats->lat_n) return eslOK;
+  fprintf(ofp, "# mean latency:       %.4f ms\n", (double) stats->lat_total * 1e-6 / (double) stats->lat_n);
+  fprintf(ofp, "# max latency:        %.4f ms\n", (double) stats->lat_max * 1e-6);
+
+  for (p = 0, cum = 0, b = 0; b < p7E_NLATBINS && p < npct; b++)
+    {
+      cum += stats->lat_hist[b];
+      for ( ; p < npct && (double) cum >= pct[p] * (double) stats->lat_n; p++)
+	fprintf(ofp, "# p%-7g latency:    <= %.4f ms\n", 100. * pct[p], (double) engine_latbin_lo(b+1) * 1e-6);
+    }
+
+  fprintf(ofp, "# %12s %12s %12s %8s\n", "ms from", "ms to", "comparisons", "cum frac");
+  for (cum = 0, b = 0; b < p7E_NLATBINS; b++)
+    if (stats->lat_hist[b])
+      {
+	cum += stats->lat_hist[b];
+	fprintf(ofp, "  %12.4f %12.4f %12" PRId64 " %8.5f\n", (double) engine_latbin_lo(b) * 1e-6, (double) engine_latbin_lo(b+1) * 1e-6,
+		stats->lat_hist[b], (double) cum / (double) stats->lat_n);
+      }
+
+  if (! stats->nslow) return eslOK;
+  ESL_ALLOC(sl, sizeof(P7_ENGINE_SLOWSEQ) * stats->nslow);
+  memcpy(sl, stats->slow, sizeof(P7_ENGINE_SLOWSEQ) * stats->nslow);
+  qsort(sl, stats->nslow, sizeof(P7_ENGINE_SLOWSEQ), engine_slowcmp);
+
+  fprintf(ofp, "# %-12s %10s %8s %-12s %12s %6s %10s\n", "slowest", "start", "L", "stage", "ncells", "mpas", "ms");
+  fprintf(ofp, "# %-12s %10s %8s %-12s %12s %6s %10s\n", "------------", "----------", "--------", "------------", "------------", "------", "----------");
+  for (p = 0; p < stats->nslow; p++)
+    {
+      fprintf(ofp, "  %-12" PRId64 " %10" PRId64 " %8d %-12s %12" PRId64, sl[p].seqidx, sl[p].subseq_start, sl[p].L, engine_stagename[sl[p].stage], sl[p].ncells);
+      if (sl[p].mpas_iter >= 0) fprintf(ofp, " %6d", sl[p].mpas_iter);
+      else                      fprintf(ofp, " %6s", "-");
+      fprintf(ofp, " %10.4f\n", (double) sl[p].ns * 1e-6);
+    }
+  free(sl);
+  return eslOK;
+
+ ERROR:
+  free(sl);
+  return status;
+}
+
+
 void
 p7_engine_stats_Destroy(P7_ENGINE_STATS *stats)
 {
-  if (stats) free(stats);
+  free(stats);
+}
+
+
+/* engine_clock()
+ * Current time in ns, on a clock that NTP doesn't slew.
+ */
+static uint64_t
+engine_clock(void)
+{
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* engine_latbin()
+ * Which bin of <lat_hist> a latency of <ns> goes in. Values below
+ * p7E_LATSUB get a bin each; above that, a value whose top bit is
+ * bit <e+p7E_LATSUBBITS> goes in sub-bucket (ns >> e) - p7E_LATSUB
+ * of block e+1.
+ */
+static int
+engine_latbin(uint64_t ns)
+{
+  int e = 0;
+
+  if (ns < p7E_LATSUB) return (int) ns;
+  while ((ns >> e) >= 2 * p7E_LATSUB) e++;
+  return (e+1) * p7E_LATSUB + (int) ((ns >> e) - p7E_LATSUB);
+}
+
+/* engine_latbin_lo()
+ * The smallest latency, in ns, that goes in bin <b>; the inverse of
+ * engine_latbin(). <b> may be p7E_NLATBINS, for the upper edge of
+ * the last bin (which saturates).
+ */
+static uint64_t
+engine_latbin_lo(int b)
+{
+  int e;
+
+  if (b < p7E_LATSUB)     return (uint64_t) b;
+  if (b >= p7E_NLATBINS)  return UINT64_MAX;
+  e = b / p7E_LATSUB - 1;
+  return (uint64_t) (p7E_LATSUB + b % p7E_LATSUB) << e;
+}
+
+/* engine_slowinsert()
+ * Add comparison <sl> to the slowest-N list in <stats>, if it's
+ * slower than the fastest one there (or there's room). The list is
+ * unordered; with only p7E_NSLOW entries, a scan for the fastest is
+ * cheap, and only happens when something gets in.
+ */
+static void
+engine_slowinsert(P7_ENGINE_STATS *stats, const P7_ENGINE_SLOWSEQ *sl)
+{
+  int i, imin;
+
+  if (stats->nslow < p7E_NSLOW)
+    {
+      stats->slow[stats->nslow++] = *sl;
+      return;
+    }
+  for (imin = 0, i = 1; i < p7E_NSLOW; i++)
+    if (stats->slow[i].ns < stats->slow[imin].ns) imin = i;
+  if (sl->ns > stats->slow[imin].ns) stats->slow[imin] = *sl;
 }
 
 
@@ -93,12 +562,20 @@ p7_engine_stats_Destroy(P7_ENGINE_STATS *stats)
  * 3. P7_ENGINE
  *****************************************************************/
 
+static int64_t engine_heldsize  (const P7_ENGINE *eng);
+static int     engine_shrink    (P7_ENGINE *eng);
+static void    engine_memsample (P7_ENGINE *eng);
+static void    engine_counters_close(P7_ENGINE *eng);
+
 P7_ENGINE *
 p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS *stats, int M_hint, int L_hint)
 {
   P7_ENGINE *eng               = NULL;
   uint32_t   rng_seed          = (prm ? prm->rng_seed          : p7_ENGINE_FIXED_SEED);
   int        sparsify_ramlimit = (prm ? prm->sparsify_ramlimit : p7_SPARSIFY_RAMLIMIT);
+  int        cache_nthreads    = (prm ? prm->cache_nthreads    : p7_ENGINE_CACHE_NTHREADS);
+  int        main_mode         = (prm ? prm->main_mode         : p7_ENGINE_MAIN_MODE);
+  int        c;
   int        status;
 
   /* level 0 */
@@ -112,7 +589,6 @@ p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS
   eng->sxf   = NULL;
   eng->sxd   = NULL;
   eng->asf   = NULL;
-  eng->asb   = NULL;
   eng->asd   = NULL;
   eng->anch  = NULL;
   eng->vanch = NULL;
@@ -120,6 +596,25 @@ p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS
   eng->env   = NULL;
   eng->tr    = NULL;
 
+  eng->mg      = NULL;
+  eng->mg_held = 0;
+
+  eng->last_L         = 0;
+  eng->last_ncells    = 0;
+  eng->last_stage     = p7E_ST_NULL;
+  eng->last_mpas_iter = -1;
+  eng->lat_t0         = 0;
+
+  eng->ctr_state = 0;
+  eng->ctr_n     = 0;
+  eng->ctr_tid   = 0;
+  for (c = 0; c < p7E_NCTRS; c++)
+    {
+      eng->ctr_fd[c]   = -1;
+      eng->ctr_slot[c] = -1;
+      eng->ctr_last[c] = 0;
+    }
+
   /* Use params if provided, else create defaults.
    * Add optional stats collection if provided.
    */
@@ -132,18 +627,23 @@ p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS
    * The initial allocation can be anything.
    */
   eng->fx    = p7_filtermx_Create  ( M_hint );
-  eng->cx    = p7_checkptmx_Create ( M_hint, L_hint, ESL_MBYTES(sparsify_ramlimit));
+  eng->cx    = p7_checkptmx_Create ( M_hint, L_hint, (cache_nthreads > 0 ? p7_checkptmx_CacheRamlimit(cache_nthreads) : ESL_MBYTES(sparsify_ramlimit)));
   eng->sm    = p7_sparsemask_Create( M_hint, L_hint);
   eng->sxf   = p7_sparsemx_Create(eng->sm);
-  eng->sxd   = p7_sparsemx_Create(eng->sm);
-  eng->asf   = p7_sparsemx_Create(eng->sm);
-  eng->asb   = p7_sparsemx_Create(eng->sm);
-  eng->asd   = p7_sparsemx_Create(eng->sm);
-  eng->anch  = p7_anchors_Create();
-  eng->vanch = p7_anchors_Create();
-  eng->ahash = p7_anchorhash_Create();
-  eng->env   = p7_envelopes_Create();
-  eng->tr    = p7_trace_CreateWithPP();
+  eng->cx_ramlimit = eng->cx->ramlimit;
+
+  /* In scores-only mode, the main engine only runs sparse Forward. */
+  if (main_mode != p7E_SCORES)
+    {
+      eng->sxd   = p7_sparsemx_Create(eng->sm);
+      eng->asf   = p7_sparsemx_Create(eng->sm);
+      eng->asd   = p7_sparsemx_Create(eng->sm);
+      eng->anch  = p7_anchors_Create();
+      eng->vanch = p7_anchors_Create();
+      eng->ahash = p7_anchorhash_Create();
+      eng->env   = p7_envelopes_Create();
+      eng->tr    = p7_trace_CreateWithPP();
+    }
 
   eng->wrkM  = NULL;  // wrkM is handled by bypass idiom; starts NULL, reallocated as needed.
   ESL_ALLOC(eng->wrkKp, abc->Kp * sizeof(float));
@@ -158,6 +658,9 @@ p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS
   eng->fsc    = 0.;
   eng->asc_f  = 0.;
 
+  eng->sm_thresh = 0.;
+  eng->sm_lost   = 0.;
+
   eng->F1     = 0.02;
   eng->F2     = 0.001;
   eng->F3     = 1e-5;
@@ -169,14 +672,17 @@ p7_engine_Create(const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS
   return NULL;
 }
 
-/*
 int
 p7_engine_Reuse(P7_ENGINE *eng)
 {
   int      rng_reproducible = (eng->params ? eng->params->rng_reproducible : p7_ENGINE_REPRODUCIBLE);
   uint32_t rng_seed         = (eng->params ? eng->params->rng_seed         : p7_ENGINE_FIXED_SEED);
+  int64_t  held;
   int status;
 
+  if (eng->stats && eng->params && eng->params->do_memory) engine_memsample(eng);
+  eng->lat_t0 = 0;
+
   if (rng_reproducible) 
     esl_randomness_Init(eng->rng, rng_seed);
 
@@ -187,23 +693,40 @@ p7_engine_Reuse(P7_ENGINE *eng)
   /* Most Reuse()'s are cheap, but the p7_anchorhash_Reuse() is a little
    * expensive. That's why we avoid Reuse()'ing the structures that only
    * the main engine uses.
-   
-  if (eng->used_main)
+   */
+  if (eng->used_main && ! eng->sxd)   // p7E_SCORES mode: only <sxf> was used.
+    {
+      if ((status = p7_sparsemx_Reuse  (eng->sxf))   != eslOK) return status;
+    }
+  else if (eng->used_main)
     {
       if ((status = p7_sparsemx_Reuse  (eng->sxf))   != eslOK) return status;
       if ((status = p7_sparsemx_Reuse  (eng->sxd))   != eslOK) return status;
       if ((status = p7_sparsemx_Reuse  (eng->asf))   != eslOK) return status;
-      if ((status = p7_sparsemx_Reuse  (eng->asb))   != eslOK) return status;
       if ((status = p7_sparsemx_Reuse  (eng->asd))   != eslOK) return status;
       if ((status = p7_anchors_Reuse   (eng->anch))  != eslOK) return status;
       if ((status = p7_anchors_Reuse   (eng->vanch)) != eslOK) return status;
       if ((status = p7_anchorhash_Reuse(eng->ahash)) != eslOK) return status;  
       if ((status = p7_envelopes_Reuse (eng->env))   != eslOK) return status;  
       if ((status = p7_trace_Reuse     (eng->tr))    != eslOK) return status;
-      /* wrkM and wrkKp are scratch workspaces, don't need to be reused/reinitialized 
+      /* wrkM and wrkKp are scratch workspaces, don't need to be reused/reinitialized */
     }
   eng->used_main = FALSE;
 
+  /* Under a memory governor: undo any checkpointing fallback, give
+   * back an outsized allocation, and true up our reservation to what
+   * we actually hold now.
+   */
+  if (eng->mg)
+    {
+      eng->cx->ramlimit = eng->cx_ramlimit;
+      if (engine_heldsize(eng) > eng->mg->keep && (status = engine_shrink(eng)) != eslOK) return status;
+      held = engine_heldsize(eng);
+      if      (held > eng->mg_held) p7_memgov_Charge (eng->mg, held - eng->mg_held);
+      else if (held < eng->mg_held) p7_memgov_Release(eng->mg, eng->mg_held - held);
+      eng->mg_held = held;
+    }
+
   eng->nullsc = 0.;
   eng->biassc = 0.;
   eng->mfsc   = 0.;
@@ -214,15 +737,19 @@ p7_engine_Reuse(P7_ENGINE *eng)
   eng->fsc    = 0.;
   eng->asc_f  = 0.;
 
-  /* F1, F2, F3 are constants, they don't need to be reset. 
+  eng->sm_thresh = 0.;
+  eng->sm_lost   = 0.;
+
+  /* F1, F2, F3 are constants, they don't need to be reset. */
   return eslOK;
 }
-*/
+
 void
 p7_engine_Destroy(P7_ENGINE *eng)
 {
   if (eng)
     {
+      if (eng->mg)    p7_memgov_Release     (eng->mg, eng->mg_held);
       if (eng->rng)   esl_randomness_Destroy(eng->rng);
       if (eng->fx)    p7_filtermx_Destroy   (eng->fx);
       if (eng->cx)    p7_checkptmx_Destroy  (eng->cx);
@@ -230,7 +757,6 @@ p7_engine_Destroy(P7_ENGINE *eng)
       if (eng->sxf)   p7_sparsemx_Destroy   (eng->sxf);
       if (eng->sxd)   p7_sparsemx_Destroy   (eng->sxd);
       if (eng->asf)   p7_sparsemx_Destroy   (eng->asf);
-      if (eng->asb)   p7_sparsemx_Destroy   (eng->asb);
       if (eng->asd)   p7_sparsemx_Destroy   (eng->asd);
       if (eng->vanch) p7_anchors_Destroy    (eng->vanch);
       if (eng->anch)  p7_anchors_Destroy    (eng->anch);
@@ -241,6 +767,7 @@ p7_engine_Destroy(P7_ENGINE *eng)
       if (eng->wrkM)  free(eng->wrkM);
       if (eng->wrkKp) free(eng->wrkKp);
 
+      engine_counters_close(eng);
       if (eng->params) p7_engine_params_Destroy(eng->params);
       if (eng->stats)  p7_engine_stats_Destroy (eng->stats);
     }
@@ -248,9 +775,550 @@ p7_engine_Destroy(P7_ENGINE *eng)
 }
 
 
+/* Function:  p7_engine_SetMemGovernor()
+ * Synopsis:  Reserve DP matrix memory from a shared budget.
+ *
+ * Purpose:   Attach memory governor <mg> to engine <eng>, or detach
+ *            the current one if <mg> is <NULL>. The engine is charged
+ *            for what its checkpointed and sparse DP matrices already
+ *            hold, and from then on reserves from <mg> before they
+ *            can grow:
+ *
+ *            <p7_engine_Overthruster()> reserves the matrix that
+ *            <p7_checkptmx_GrowTo()> will lay out for the Forward and
+ *            Backward filters. If that's refused, it falls back to a
+ *            minimal fully checkpointed matrix for this comparison,
+ *            trading Forward recomputation for memory. If even that
+ *            is refused, it returns <eslENORESULT>.
+ *
+ *            <p7_engine_Main()> reserves the sparse matrices that the
+ *            sparse mask calls for, with the anchor set constrained
+ *            (ASC) matrices at twice that size, an upper bound, since
+ *            the anchors aren't known yet. It returns <eslENORESULT>
+ *            if that's refused.
+ *
+ *            A caller that gets <eslENORESULT> should set the
+ *            comparison aside for an engine that isn't governed.
+ *
+ *            At each <p7_engine_Reuse()>, an engine that is holding
+ *            more than the governor's <keep> frees its matrices back
+ *            to small initial sizes, and its reservation is trued up
+ *            to what it actually holds.
+ *
+ *            The engine only keeps a reference to <mg>. Several
+ *            engines share one governor, and the caller frees it
+ *            after all of them have been destroyed or detached.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_engine_SetMemGovernor(P7_ENGINE *eng, P7_MEMGOV *mg)
+{
+  if (eng->mg)
+    {
+      p7_memgov_Release(eng->mg, eng->mg_held);
+      eng->cx->ramlimit = eng->cx_ramlimit;
+    }
+
+  eng->mg      = mg;
+  eng->mg_held = 0;
+  if (mg)
+    {
+      eng->mg_held = engine_heldsize(eng);
+      p7_memgov_Charge(mg, eng->mg_held);
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_engine_DetachFiltered()
+ * Synopsis:  Set aside the Overthruster's result, to run Main later.
+ *
+ * Purpose:   After <p7_engine_Overthruster()> has passed a comparison,
+ *            take what it left for <p7_engine_Main()> out of engine
+ *            <eng>: the sparse mask <eng->sm>, the filter scores, and
+ *            the sparsify threshold. Return them in a new
+ *            <P7_ENGINE_FILTERED> in <*ret_flt>. The engine gets a
+ *            new, small sparse mask in place of the one taken, and can
+ *            be <p7_engine_Reuse()>'d and go on to other comparisons.
+ *
+ *            Later, <p7_engine_AttachFiltered()> gives them to an
+ *            engine (this one or another with the same parameters)
+ *            to run <p7_engine_Main()> on, without rerunning the
+ *            filters.
+ *
+ *            The detached mask is O(L) memory that no memory governor
+ *            accounts for; the governor only counts the DP matrices.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eng> is unchanged, and
+ *            <*ret_flt> is <NULL>.
+ */
+int
+p7_engine_DetachFiltered(P7_ENGINE *eng, P7_ENGINE_FILTERED **ret_flt)
+{
+  P7_ENGINE_FILTERED *flt = NULL;
+  P7_SPARSEMASK      *sm  = NULL;
+  int                 status;
+
+  ESL_ALLOC(flt, sizeof(P7_ENGINE_FILTERED));
+  if ((sm = p7_sparsemask_Create(eng->sm->M, 100)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  flt->sm        = eng->sm;
+  flt->nullsc    = eng->nullsc;
+  flt->biassc    = eng->biassc;
+  flt->mfsc      = eng->mfsc;
+  flt->vfsc      = eng->vfsc;
+  flt->ffsc      = eng->ffsc;
+  flt->sm_thresh = eng->sm_thresh;
+  flt->sm_lost   = eng->sm_lost;
+  flt->L         = eng->last_L;
+  flt->lat_ns    = (eng->lat_t0 ? engine_clock() - eng->lat_t0 : 0);
+
+  eng->sm     = sm;
+  eng->lat_t0 = 0;
+  *ret_flt    = flt;
+  return eslOK;
+
+ ERROR:
+  free(flt);
+  *ret_flt = NULL;
+  return status;
+}
+
+/* Function:  p7_engine_AttachFiltered()
+ * Synopsis:  Resume a comparison set aside by p7_engine_DetachFiltered().
+ *
+ * Purpose:   Give the sparse mask and filter scores in <flt> to engine
+ *            <eng>, as if <p7_engine_Overthruster()> had just passed
+ *            the comparison there. Caller goes on to call
+ *            <p7_engine_Main()> with the same target.
+ *
+ *            <eng> must be fresh or <p7_engine_Reuse()>'d. <flt> is
+ *            consumed: the engine takes its mask, and it is freed.
+ *
+ *            The filter stats aren't counted again; they were counted
+ *            on the engine that ran the filters. If the engine is
+ *            recording latencies, the comparison's time so far carries
+ *            over, so <p7_engine_RecordLatency()> reports the time
+ *            spent on it, not counting the time it was set aside.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_engine_AttachFiltered(P7_ENGINE *eng, P7_ENGINE_FILTERED *flt)
+{
+  p7_sparsemask_Destroy(eng->sm);
+  eng->sm        = flt->sm;
+  eng->nullsc    = flt->nullsc;
+  eng->biassc    = flt->biassc;
+  eng->mfsc      = flt->mfsc;
+  eng->vfsc      = flt->vfsc;
+  eng->ffsc      = flt->ffsc;
+  eng->sm_thresh = flt->sm_thresh;
+  eng->sm_lost   = flt->sm_lost;
+
+  eng->last_L         = flt->L;
+  eng->last_ncells    = eng->sm->ncells;
+  eng->last_stage     = p7E_ST_BCK;
+  eng->last_mpas_iter = -1;
+  if (eng->stats && eng->params && eng->params->do_latency) eng->lat_t0 = engine_clock() - flt->lat_ns;
+
+  flt->sm = NULL;
+  free(flt);
+  return eslOK;
+}
+
+/* Function:  p7_engine_filtered_Destroy()
+ * Synopsis:  Free a P7_ENGINE_FILTERED that won't be attached.
+ */
+void
+p7_engine_filtered_Destroy(P7_ENGINE_FILTERED *flt)
+{
+  if (flt)
+    {
+      if (flt->sm) p7_sparsemask_Destroy(flt->sm);
+      free(flt);
+    }
+}
+
+
+/* engine_heldsize()
+ * Bytes held by the engine's checkpointed and sparse DP matrices:
+ * the ones that scale with L, and that the governor accounts for.
+ */
+static int64_t
+engine_heldsize(const P7_ENGINE *eng)
+{
+  int64_t n = p7_checkptmx_Sizeof(eng->cx) + p7_sparsemx_Sizeof(eng->sxf);
+  if (eng->sxd) n += p7_sparsemx_Sizeof(eng->sxd);
+  if (eng->asf) n += p7_sparsemx_Sizeof(eng->asf);
+  if (eng->asd) n += p7_sparsemx_Sizeof(eng->asd);
+  return n;
+}
+
+/* engine_memsample()
+ * Record the size of each DP structure at the end of a comparison,
+ * before Reuse() (and, under a memory governor, any shrink), with
+ * new high-water marks and which comparison set them.
+ */
+static void
+engine_memsample(P7_ENGINE *eng)
+{
+  P7_ENGINE_STATS *stats = eng->stats;
+  int64_t          n[p7E_NMEM];
+  int64_t          total = 0;
+  int              M     = eng->sm->M;
+  int              s;
+
+  n[p7E_MEM_FX]    = p7_filtermx_Sizeof(eng->fx);
+  n[p7E_MEM_CX]    = p7_checkptmx_Sizeof(eng->cx);
+  n[p7E_MEM_SM]    = p7_sparsemask_Sizeof(eng->sm);
+  n[p7E_MEM_SXF]   = p7_sparsemx_Sizeof(eng->sxf);
+  n[p7E_MEM_SXD]   = (eng->sxd   ? p7_sparsemx_Sizeof(eng->sxd)     : 0);
+  n[p7E_MEM_ASF]   = (eng->asf   ? p7_sparsemx_Sizeof(eng->asf)     : 0);
+  n[p7E_MEM_ASD]   = (eng->asd   ? p7_sparsemx_Sizeof(eng->asd)     : 0);
+  n[p7E_MEM_AHASH] = (eng->ahash ? p7_anchorhash_Sizeof(eng->ahash) : 0);
+
+  for (s = 0; s < p7E_NMEM; s++)
+    {
+      if (n[s] > stats->mem_cur[s]) stats->mem_ngrow[s]++;
+      if (n[s] > stats->mem_peak[s])
+	{
+	  stats->mem_peak[s]        = n[s];
+	  stats->mem_peak_L[s]      = eng->last_L;
+	  stats->mem_peak_M[s]      = M;
+	  stats->mem_peak_ncells[s] = eng->last_ncells;
+	}
+      stats->mem_cur[s] = n[s];
+      total += n[s];
+    }
+  if (total > stats->mem_total_peak)
+    {
+      stats->mem_total_peak        = total;
+      stats->mem_total_peak_L      = eng->last_L;
+      stats->mem_total_peak_M      = M;
+      stats->mem_total_peak_ncells = eng->last_ncells;
+    }
+  stats->sm_krealloc = eng->sm->n_krealloc;
+  stats->sm_rrealloc = eng->sm->n_rrealloc;
+  stats->sm_srealloc = eng->sm->n_srealloc;
+}
+
+/* engine_shrink()
+ * Replace the checkpointed and sparse matrices with small new ones.
+ * Their DP routines grow them again as needed.
+ */
+static int
+engine_shrink(P7_ENGINE *eng)
+{
+  P7_SPARSEMX **sxp[4] = { &(eng->sxf), &(eng->sxd), &(eng->asf), &(eng->asd) };
+  int           i;
+
+  p7_checkptmx_Destroy(eng->cx);
+  if ((eng->cx = p7_checkptmx_Create(100, 100, eng->cx_ramlimit)) == NULL) return eslEMEM;
+
+  for (i = 0; i < 4; i++)
+    if (*sxp[i])
+      {
+	p7_sparsemx_Destroy(*sxp[i]);
+	if ((*sxp[i] = p7_sparsemx_Create(NULL)) == NULL) return eslEMEM;
+      }
+  return eslOK;
+}
+
+
+/* engine_counters_close()
+ * Close any open hardware counters: when the engine is destroyed, or
+ * so they can be reopened from another thread.
+ */
+static void
+engine_counters_close(P7_ENGINE *eng)
+{
+  int c;
+
+  for (c = p7E_NCTRS-1; c >= 0; c--)
+    {
+#if defined(__linux__)
+      if (eng->ctr_fd[c] >= 0) close(eng->ctr_fd[c]);
+#endif
+      eng->ctr_fd[c]   = -1;
+      eng->ctr_slot[c] = -1;
+    }
+  eng->ctr_n     = 0;
+  eng->ctr_state = 0;
+}
+
+
 /*****************************************************************
  * 4. The engines themselves.
  *****************************************************************/
+#ifdef p7_ENGINE_KERNELS
+
+/* engine_counters_open()
+ * Open the hardware event counters as one perf_event group that
+ * counts the calling thread, in user space only (which most
+ * perf_event_paranoid settings allow), and start them. Cycles lead
+ * the group; if they can't be opened, no counters are available.
+ * Any other counter the CPU or kernel doesn't offer is left out, and
+ * those that open are marked in <eng->stats->ctr_avail>.
+ * Sets <eng->ctr_state> to 1 if counters are open, -1 if not.
+ */
+static void
+engine_counters_open(P7_ENGINE *eng)
+{
+#if defined(__linux__) && defined(PERF_FORMAT_GROUP)
+  static const uint32_t type[p7E_NCTRS]   = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+  static const uint64_t config[p7E_NCTRS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_LL  | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_BRANCH_MISSES };
+  struct perf_event_attr pe;
+  int c;
+
+  eng->ctr_state = -1;
+  eng->ctr_n     = 0;
+  eng->ctr_tid   = (long) syscall(SYS_gettid);
+  for (c = 0; c < p7E_NCTRS; c++)
+    {
+      memset(&pe, 0, sizeof(struct perf_event_attr));
+      pe.size           = sizeof(struct perf_event_attr);
+      pe.type           = type[c];
+      pe.config         = config[c];
+      pe.read_format    = PERF_FORMAT_GROUP;
+      pe.disabled       = (c == 0 ? 1 : 0);
+      pe.exclude_kernel = 1;
+      pe.exclude_hv     = 1;
+
+      eng->ctr_fd[c] = (int) syscall(SYS_perf_event_open, &pe, 0, -1, (c == 0 ? -1 : eng->ctr_fd[0]), 0);
+      if (eng->ctr_fd[c] < 0)
+	{
+	  if (c == 0) return;
+	  eng->ctr_slot[c] = -1;
+	  continue;
+	}
+      eng->ctr_slot[c]         = eng->ctr_n++;
+      eng->stats->ctr_avail[c] = TRUE;
+    }
+  ioctl(eng->ctr_fd[0], PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+  ioctl(eng->ctr_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  eng->ctr_state = 1;
+#else
+  eng->ctr_state = -1;
+#endif
+}
+
+/* engine_counters_readgroup()
+ * Read the counter group led by <fd> into <buf>, <n> bytes. Returns
+ * <eslOK> on success, or <eslFAIL> on a short read, or always off
+ * Linux (where no counters are ever open).
+ */
+static int
+engine_counters_readgroup(int fd, uint64_t *buf, size_t n)
+{
+#if defined(__linux__)
+  if (read(fd, buf, n) == (ssize_t) n) return eslOK;
+#endif
+  return eslFAIL;
+}
+
+/* engine_counters_read()
+ * Read all open counters in one go into <v>; unavailable ones read 0.
+ */
+static void
+engine_counters_read(P7_ENGINE *eng, uint64_t *v)
+{
+  uint64_t buf[1 + p7E_NCTRS];    // PERF_FORMAT_GROUP: nr, then one value per counter in the group
+  int      c;
+
+  if (engine_counters_readgroup(eng->ctr_fd[0], buf, sizeof(uint64_t) * (1 + eng->ctr_n)) != eslOK)
+    for (c = 0; c <= eng->ctr_n; c++) buf[c] = 0;
+  for (c = 0; c < p7E_NCTRS; c++)
+    v[c] = (eng->ctr_slot[c] >= 0 ? buf[1 + eng->ctr_slot[c]] : 0);
+}
+
+/* engine_start()
+ * Start timing (and counting) a run of stages: returns the current
+ * clock, and snapshots the counters if <eng->params->do_counters> is set.
+ * Counters count only the thread that opened them, so they're opened
+ * on first use, and reopened if the engine has since moved to a
+ * different thread.
+ */
+static uint64_t
+engine_start(P7_ENGINE *eng)
+{
+  if (eng->params->do_counters)
+    {
+#if defined(__linux__)
+      if (eng->ctr_state == 1 && eng->ctr_tid != (long) syscall(SYS_gettid)) engine_counters_close(eng);
+#endif
+      if (eng->ctr_state == 0) engine_counters_open(eng);
+      if (eng->ctr_state == 1) engine_counters_read(eng, eng->ctr_last);
+    }
+  return engine_clock();
+}
+
+/* engine_stagetime()
+ * Charge the time (and counted events) since <t0> to stage <s>,
+ * without counting another call: for extra work done on behalf of
+ * a call that's already counted. Returns the current clock. Only
+ * called when <eng->params->do_timing> or <eng->params->do_counters>
+ * is set, with <eng->stats> to charge.
+ */
+static uint64_t
+engine_stagetime(P7_ENGINE *eng, int s, uint64_t t0)
+{
+  P7_ENGINE_STATS *stats = eng->stats;
+  uint64_t         t     = engine_clock();
+  uint64_t         v[p7E_NCTRS];
+  int              c;
+
+  if (eng->ctr_state == 1)
+    {
+      engine_counters_read(eng, v);
+      for (c = 0; c < p7E_NCTRS; c++)
+	{
+	  stats->stage_ctr[s][c] += v[c] - eng->ctr_last[c];
+	  eng->ctr_last[c]        = v[c];
+	}
+    }
+  stats->stage_ns[s] += t - t0;
+  return t;
+}
+
+/* engine_stage()
+ * Charge the time (and counted events) since <t0> to stage <s>, as one
+ * call that processed <L> residues. Returns the current clock, so
+ * calls can be chained to time consecutive stages. Same conditions
+ * as engine_stagetime().
+ */
+static uint64_t
+engine_stage(P7_ENGINE *eng, int s, uint64_t t0, int L)
+{
+  uint64_t t = engine_stagetime(eng, s, t0);
+
+  eng->stats->stage_calls[s] += 1;
+  eng->stats->stage_res[s]   += L;
+  return t;
+}
+
+/* engine_anchorset_bound()
+ * An upper bound on the probability of anchor set <anch>, from the
+ * sparse decoding matrix <sxd>: every path consistent with the anchor
+ * set passes through each anchor cell (i0,k0) in an M state, so the
+ * anchor set can be no more probable than its least probable anchor
+ * cell. Anchors that fall outside the sparse mask bound it at 0.
+ * This lets us skip an ASC Forward that couldn't pass the MPAS fast
+ * path test anyway.
+ */
+static float
+engine_anchorset_bound(const P7_SPARSEMX *sxd, const P7_ANCHORS *anch)
+{
+  const P7_SPARSEMASK *sm   = sxd->sm;
+  const float         *dpc  = sxd->dp;   // steps through stored rows; on row i's first supercell
+  float                pmin = 1.0;
+  float                pp;
+  int                  i    = 1;
+  int                  d, v;
+
+  for (d = 1; d <= anch->D; d++)
+    {
+      for (; i < anch->a[d].i0; i++) dpc += p7S_NSCELLS * sm->n[i];
+      for (v = 0; v < sm->n[i] && sm->k[i][v] < anch->a[d].k0; v++) ;
+      pp   = (v < sm->n[i] && sm->k[i][v] == anch->a[d].k0) ?
+	     dpc[v*p7S_NSCELLS + p7S_ML] + dpc[v*p7S_NSCELLS + p7S_MG] : 0.0;
+      pmin = ESL_MIN(pmin, pp);
+    }
+  return pmin;
+}
+
+/* engine_reserve()
+ * Make sure the engine has at least <need> bytes reserved in total.
+ * Returns <eslOK> if it does, <eslENORESULT> if the governor refused.
+ */
+static int
+engine_reserve(P7_ENGINE *eng, int64_t need)
+{
+  if (need <= eng->mg_held) return eslOK;
+  if (p7_memgov_Reserve(eng->mg, need - eng->mg_held) != eslOK) return eslENORESULT;
+  eng->mg_held = need;
+  return eslOK;
+}
+
+/* engine_reserve_cx()
+ * Reserve for the checkpointed matrix of an <M> by <L> comparison,
+ * falling back to a minimal checkpointed layout if necessary.
+ * Returns <eslOK> or <eslENORESULT>.
+ */
+static int
+engine_reserve_cx(P7_ENGINE *eng, int M, int L)
+{
+  int64_t others = engine_heldsize(eng) - p7_checkptmx_Sizeof(eng->cx);
+
+  if (engine_reserve(eng, others + p7_checkptmx_PlanSizeof(eng->cx, M, L, 0)) == eslOK)
+    return eslOK;
+
+  eng->cx->ramlimit = p7_checkptmx_MinSizeof(M, L);  // _GrowTo() downsizes to the fully checkpointed layout; _Reuse() restores the limit
+  if (engine_reserve(eng, others + p7_checkptmx_PlanSizeof(eng->cx, M, L, 0)) == eslOK)
+    {
+      if (eng->stats) eng->stats->n_mem_fallback++;
+      return eslOK;
+    }
+
+  eng->cx->ramlimit = eng->cx_ramlimit;
+  if (eng->stats) eng->stats->n_mem_deferred++;
+  return eslENORESULT;
+}
+
+/* engine_refilter()
+ * Rerun the Forward filter for another Backward decoding pass
+ * at a new sparsification threshold, on reused matrices.
+ */
+static int
+engine_refilter(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_OPROFILE *om)
+{
+  int status;
+
+  if ((status = p7_checkptmx_Reuse (eng->cx)) != eslOK) return status;
+  if ((status = p7_sparsemask_Reuse(eng->sm)) != eslOK) return status;
+  return p7_ForwardFilter(dsq, L, om, eng->cx, &(eng->ffsc));
+}
+
+/* engine_overbudget()
+ * TRUE if sparse mask <sm> has more than <maxcells> cells in total, or
+ * more than <maxrow> on any one row. A limit of 0 means no limit.
+ */
+static int
+engine_overbudget(const P7_SPARSEMASK *sm, int64_t maxcells, int maxrow)
+{
+  int i;
+
+  if (maxcells && sm->ncells > maxcells) return TRUE;
+  if (maxrow)
+    for (i = 1; i <= sm->L; i++)
+      if (sm->n[i] > maxrow) return TRUE;
+  return FALSE;
+}
+
+/* engine_densitybin()
+ * Which bin of <density_hist> a sparse mask of <ncells> cells for
+ * an <L> x <M> comparison falls in; see <p7E_NDENSBINS>.
+ */
+static int
+engine_densitybin(int64_t ncells, int L, int M)
+{
+  double d = (double) ncells / ((double) L * (double) M);
+  int    b;
+
+  if (d < 1e-5) return 0;
+  b = 1 + (int) floor(2. * (log10(d) + 5.));
+  return ESL_MIN(b, p7E_NDENSBINS-1);
+}
+
+
 
 /* Function:  p7_engine_Overthruster()
  * Synopsis:  The acceleration filters.
@@ -291,167 +1359,904 @@ p7_engine_Destroy(P7_ENGINE *eng)
  *            <eng->stats>, its <n_past_msv>, <n_past_bias>,
  *            <n_past_vit>, <n_ran_vit>, <n_past_fwd> counters can advance here.
  *            
+ *            If the engine's params set a sparse mask cell budget
+ *            (<sparsify_maxcells>, <sparsify_maxrow>) and the mask at
+ *            <sparsify_thresh> is over it, the threshold is doubled and
+ *            the Forward/Backward filters rerun on reused matrices,
+ *            until the budget is met or the threshold reaches
+ *            <p7_SPARSIFY_THRESH_MAX>. A row over <sparsify_maxrow> is
+ *            handled by the same global threshold; there's no per-row
+ *            top-N. The threshold that was used is left in
+ *            <eng->sm_thresh>. Every cell that was dropped had a
+ *            posterior probability below it, so <eng->sm_lost> =
+ *            (cells dropped) * <sm_thresh> is an upper bound, usually
+ *            a loose one, on the posterior mass lost. If raising the
+ *            threshold would empty the mask, the last nonempty one is
+ *            kept.
+ *            With <eng->stats>, <n_sparsify_raised>,
+ *            <sparsify_cells_dropped> and <sparsify_lost> accumulate.
+ *
  *            The O(M) filter DP matrix <eng->fx> and the O(M sqrt L) checkpoint
  *            matrix <eng->cx> may be reallocated here.
+ *
+ *            If the engine has a memory governor (see
+ *            <p7_engine_SetMemGovernor()>) and it can't reserve even a
+ *            minimal checkpoint matrix, return <eslENORESULT> before
+ *            the Forward filter; the caller should defer the
+ *            comparison.
  *            
  * Throws:    <eslEMEM> if a DP matrix reallocation fails.           
  *            
  */
-/*
 int
 p7_engine_Overthruster(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_BG *bg)
 {
-  int   do_biasfilter    = (eng->params ? eng->params->do_biasfilter   : p7_ENGINE_DO_BIASFILTER);
-  float sparsify_thresh  = (eng->params ? eng->params->sparsify_thresh : p7_SPARSIFY_THRESH);
-  float seq_score;
+  int     do_biasfilter     = (eng->params ? eng->params->do_biasfilter     : p7_ENGINE_DO_BIASFILTER);
+  float   sparsify_thresh   = (eng->params ? eng->params->sparsify_thresh   : p7_SPARSIFY_THRESH);
+  int64_t sparsify_maxcells = (eng->params ? eng->params->sparsify_maxcells : p7_SPARSIFY_MAXCELLS);
+  int     sparsify_maxrow   = (eng->params ? eng->params->sparsify_maxrow   : p7_SPARSIFY_MAXROW);
+  int     timer             = (eng->stats && eng->params && (eng->params->do_timing || eng->params->do_counters));
+  int     ran_vit           = FALSE;
+  uint64_t t0               = 0;
+  int64_t ncells0;
+  float   thresh;
+  float   seq_score;
   float P;
   int   status;
 
   if (L == 0) return eslFAIL;
-
+  if (eng->stats) { eng->stats->n_seqs++; eng->stats->res_seqs += L; }
+  if (eng->stats && eng->params && eng->params->do_latency) eng->lat_t0 = engine_clock();
+  eng->last_L         = L;
+  eng->last_ncells    = 0;
+  eng->last_stage     = p7E_ST_MSV;
+  eng->last_mpas_iter = -1;
+
+  if (timer) t0 = engine_start(eng);
   if ((status = p7_bg_NullOne(bg, dsq, L, &(eng->nullsc))) != eslOK) return status; 
+  if (timer) t0 = engine_stage(eng, p7E_ST_NULL, t0, L);
 
-  /* First level: SSV and MSV filters 
+  /* First level: SSV and MSV filters */
   status = p7_MSVFilter(dsq, L, om, eng->fx, &(eng->mfsc));
   if (status != eslOK && status != eslERANGE) return status;
+  if (timer) t0 = engine_stage(eng, p7E_ST_MSV, t0, L);
 
   seq_score = (eng->mfsc - eng->nullsc) / eslCONST_LOG2;          
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
   if (P > eng->F1) return eslFAIL;
-  if (eng->stats) eng->stats->n_past_msv++;
+  if (eng->stats) { eng->stats->n_past_msv++; eng->stats->res_past_msv += L; }
 
-  /* Biased composition HMM, ad hoc, acts as a modified null 
+  /* Biased composition HMM, ad hoc, acts as a modified null */
   if (do_biasfilter)
     {
+      eng->last_stage = p7E_ST_BIAS;
       if ((status = p7_bg_FilterScore(bg, dsq, L, &(eng->biassc))) != eslOK) return status;
+      if (timer) t0 = engine_stage(eng, p7E_ST_BIAS, t0, L);
       seq_score = (eng->mfsc - eng->biassc) / eslCONST_LOG2;
       P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
       if (P > eng->F1) return eslFAIL;
     }
   else eng->biassc = eng->nullsc;
-  if (eng->stats) eng->stats->n_past_bias++;
+  if (eng->stats) { eng->stats->n_past_bias++; eng->stats->res_past_bias += L; }
 
   // TODO: in scan mode, you have to load the rest of the oprofile now,
   // configure its length model, and get GA/TC/NC thresholds.
 
-  /* Second level: ViterbiFilter(), multihit with <om> 
+  /* Second level: ViterbiFilter(), multihit with <om> */
   if (P > eng->F2)
     {
       if (eng->stats) eng->stats->n_ran_vit++;
+      eng->last_stage = p7E_ST_VIT;
+      ran_vit = TRUE;
 
       //printf("P = %.4f. Running Vit Filter\n", P);
 
+      if (timer) t0 = engine_start(eng);
       status = p7_ViterbiFilter(dsq, L, om, eng->fx, &(eng->vfsc));  
       if (status != eslOK && status != eslERANGE) return status;
+      if (timer) t0 = engine_stage(eng, p7E_ST_VIT, t0, L);
 
       seq_score = (eng->vfsc - eng->biassc) / eslCONST_LOG2;
       P  = esl_gumbel_surv(seq_score,  om->evparam[p7_VMU],  om->evparam[p7_VLAMBDA]);
       if (P > eng->F2) return eslFAIL;
     }
-  if (eng->stats) eng->stats->n_past_vit++;
+  else
+    {
+      eng->vfsc = -eslINFINITY;   // skipped; PredictMainCost() falls back to <mfsc>
+      if (eng->stats) eng->stats->n_f2_shortcut++;
+    }
+  if (eng->stats) { eng->stats->n_past_vit++; eng->stats->res_past_vit += L; }
 
 
   /* Checkpointed vectorized Forward, local-only.
-   
+   * Under a memory governor, reserve its matrix first. If we can't,
+   * the comparison will be deferred and rerun from the top, so take
+   * back the filter stats it's added so far; the rerun adds them.
+   */
+  if (eng->mg && (status = engine_reserve_cx(eng, om->M, L)) != eslOK)
+    {
+      if (eng->stats)
+	{
+	  eng->stats->n_seqs--;      eng->stats->res_seqs      -= L;
+	  eng->stats->n_past_msv--;  eng->stats->res_past_msv  -= L;
+	  eng->stats->n_past_bias--; eng->stats->res_past_bias -= L;
+	  eng->stats->n_past_vit--;  eng->stats->res_past_vit  -= L;
+	  if (ran_vit) eng->stats->n_ran_vit--; else eng->stats->n_f2_shortcut--;
+	}
+      return status;
+    }
+  eng->last_stage = p7E_ST_FWD;
+
+  if (timer) t0 = engine_start(eng);
   status = p7_ForwardFilter (dsq, L, om, eng->cx, &(eng->ffsc));
   if (status != eslOK) return status;
+  if (timer) t0 = engine_stage(eng, p7E_ST_FWD, t0, L);
 
   seq_score = (eng->ffsc - eng->biassc) / eslCONST_LOG2;
   P  = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
   if (P > eng->F3) return eslFAIL;
-  if (eng->stats) eng->stats->n_past_fwd++;
+  if (eng->stats) { eng->stats->n_past_fwd++; eng->stats->res_past_fwd += L; }
+  eng->last_stage = p7E_ST_BCK;
 
   /* Sequence has passed all acceleration filters.
    * Calculate the sparse mask, by checkpointed vectorized decoding.
-  
+   */
+  if (timer) t0 = engine_start(eng);
   p7_BackwardFilter(dsq, L, om, eng->cx, eng->sm, sparsify_thresh);
+  if (timer) t0 = engine_stage(eng, p7E_ST_BCK, t0, L);
+  eng->sm_thresh = sparsify_thresh;
+  eng->sm_lost   = 0.;
 
-  return eslOK;
-}
+  /* Optional cell budget: raise the threshold until the mask fits.
+   * Backward decoding needs a fresh Forward pass each time.
+   */
+  if (engine_overbudget(eng->sm, sparsify_maxcells, sparsify_maxrow))
+    {
+      ncells0 = eng->sm->ncells;
+      thresh  = sparsify_thresh;
+      while (thresh < p7_SPARSIFY_THRESH_MAX && engine_overbudget(eng->sm, sparsify_maxcells, sparsify_maxrow))
+	{
+	  thresh = ESL_MIN(2. * thresh, p7_SPARSIFY_THRESH_MAX);
+	  if ((status = engine_refilter(eng, dsq, L, om)) != eslOK) return status;
+	  p7_BackwardFilter(dsq, L, om, eng->cx, eng->sm, thresh);
+
+	  if (eng->sm->ncells == 0)  // went too far: back up to the last mask that had cells, and stop
+	    {
+	      if ((status = engine_refilter(eng, dsq, L, om)) != eslOK) return status;
+	      p7_BackwardFilter(dsq, L, om, eng->cx, eng->sm, eng->sm_thresh);
+	      break;
+	    }
+	  eng->sm_thresh = thresh;
+	}
 
+      if (timer) t0 = engine_stagetime(eng, p7E_ST_BCK, t0);   // reruns' time goes to Backward, including their Forward passes, as part of its one call
+      eng->sm_lost = (float) (ncells0 - eng->sm->ncells) * eng->sm_thresh;
+      if (eng->stats && eng->sm_thresh > sparsify_thresh)
+	{
+	  eng->stats->n_sparsify_raised++;
+	  eng->stats->sparsify_cells_dropped += ncells0 - eng->sm->ncells;
+	  eng->stats->sparsify_lost          += eng->sm_lost;
+	}
+    }
 
-*/
+  if (eng->stats) eng->stats->density_hist[engine_densitybin(eng->sm->ncells, L, om->M)]++;
+  eng->last_ncells = eng->sm->ncells;
+  return eslOK;
+}
 
 
   // om is assumed to be complete, w/ GA/NC/TC thresholds set, and w/ length model set.
   // Use dsq, L -- not sq -- so subseqs can be processed (should help longtarget/nhmmer)
-/* Function:  
- * Synopsis:  
+/* Function:  p7_engine_Main()
+ * Synopsis:  The main engine: scores, domains, alignments.
  *
- * Purpose:   
+ * Purpose:   Using engine <eng>, compare sequence <dsq> of length <L>
+ *            to dual-mode profile <gm>, using the sparse mask that 
+ *            <p7_engine_Overthruster()> left in <eng->sm>.
  *
- * Args:      
+ *            How far the analysis goes is set by <main_mode> in the
+ *            engine's parameters. <p7E_SCORES> stops after the sparse
+ *            Forward score <fsc>; <p7E_DOMAINS> stops after envelopes
+ *            and their null2 corrections, skipping alignment; 
+ *            <p7E_FULL> (the default) does everything.
  *
  * Returns:   <eslOK> on success, and the Engine <eng> contains results in eng->*:
  *               fsc  : sparse Forward raw score for the whole seq
- *               asc_f: sparse ASC Forward raw score, also for the whole sequence
- *               tr:  optimal alignment of the target sequence 
- *               env: envelope information:
+ *               asc_f: sparse ASC Forward raw score, also for the whole sequence  [not p7E_SCORES]
+ *               tr:  optimal alignment of the target sequence                     [p7E_FULL only]
+ *               env: envelope information:                                        [not p7E_SCORES]
  *                    D : number of domains
  *                    and for each domain 1..D in env->arr[d].*:
  *                       i0,k0    : anchor
  *                       ia,ib    : envelope on seq
- *                       ka,kb    : alignment start/end on model
+ *                       ka,kb    : alignment start/end on model                   [p7E_FULL only]
  *                       oa,ob    : outer envelope 
  *                       env_sc   : envelope raw score
  *                       null2_sc : envelope null2 score correction
  *                  
- *
+ *            <eslENORESULT> if the engine has a memory governor that
+ *            refused to reserve the sparse matrices; nothing has been
+ *            computed, and the caller should defer the comparison.
  *
  * Throws:    (no abnormal error conditions)
  *
  * Xref:      
  */
 
-/*
 int
 p7_engine_Main(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_PROFILE *gm)
 {
   P7_MPAS_PARAMS *mpas_params     = (eng->params && eng->params->mpas_params ? eng->params->mpas_params : NULL);
+  int             main_mode       = (eng->params ? eng->params->main_mode : p7_ENGINE_MAIN_MODE);
+  float           loss_threshold  = (mpas_params ? mpas_params->loss_threshold : p7_MPAS_LOSS_THRESHOLD);
+  int             nmax_sampling   = (mpas_params ? mpas_params->nmax_sampling  : p7_MPAS_NMAX_SAMPLING);
+  float           vit_asc         = -eslINFINITY;
+  int             timer           = (eng->stats && eng->params && (eng->params->do_timing || eng->params->do_counters));
+  uint64_t        t0              = 0;
+  int64_t         need;
+  int64_t         asc_need;
+
+  /* Under a memory governor, reserve the sparse matrices first.
+   * ASC matrices store an UP and a DOWN sector, and each of the
+   * mask's cells is in at most one of each, so until MPAS has chosen
+   * the anchors, twice the sparse matrix size bounds them. <sxf> is
+   * borrowed for ASC Backward, so it gets the ASC bound too.
+   */
+  if (eng->mg)
+    {
+      asc_need = 2 * (int64_t) p7_sparsemx_MinSizeof(eng->sm);
+      need     = p7_checkptmx_Sizeof(eng->cx);
+      if (main_mode == p7E_SCORES)
+	need += ESL_MAX(p7_sparsemx_Sizeof(eng->sxf), p7_sparsemx_MinSizeof(eng->sm));
+      else
+	{
+	  need += ESL_MAX(p7_sparsemx_Sizeof(eng->sxf), asc_need);
+	  need += ESL_MAX(p7_sparsemx_Sizeof(eng->sxd), p7_sparsemx_MinSizeof(eng->sm));
+	  need += ESL_MAX(p7_sparsemx_Sizeof(eng->asf), asc_need);
+	  need += ESL_MAX(p7_sparsemx_Sizeof(eng->asd), asc_need);
+	}
+      if (engine_reserve(eng, need) != eslOK)
+	{
+	  if (eng->stats) eng->stats->n_mem_deferred++;
+	  return eslENORESULT;
+	}
+    }
 
+  if (eng->stats) eng->stats->n_main++;
+  eng->last_stage = (main_mode == p7E_SCORES  ? p7E_ST_SFWD  :
+		     main_mode == p7E_DOMAINS ? p7E_ST_NULL2 : p7E_ST_AEC);
   eng->used_main = TRUE;  // This flag causes engine_Reuse() to reuse all of the engine, 
                           // not just the structures used by the Overthruster.
+  if (timer) t0 = engine_start(eng);
+
+  /* Scores only: the sparse Forward score is all we need. */
+  if (main_mode == p7E_SCORES)
+    {
+      p7_SparseForward(dsq, L, gm, eng->sm, eng->sxf, &(eng->fsc));
+      if (timer) engine_stage(eng, p7E_ST_SFWD, t0, L);
+      return eslOK;
+    }
 
   /* First pass analysis 
    * Uses two sparse matrices: <sxf>, <sxd>,
    * and also gets the unconstrained Viterbi trace, <tr>
-   
-  p7_SparseViterbi (dsq, L, gm, eng->sm,  eng->sxf, eng->tr, &(eng->vsc));
-  p7_SparseForward (dsq, L, gm, eng->sm,  eng->sxf,          &(eng->fsc));
-  p7_SparseBackward(dsq, L, gm, eng->sm,  eng->sxd,          /*bsc=NULL);
-  p7_SparseDecoding(dsq, L, gm, eng->sxf, eng->sxd,          eng->sxd);
+   */
+  p7_SparseViterbi (dsq, L, gm, eng->sm,  eng->sxf, eng->tr, &(eng->vsc));   if (timer) t0 = engine_stage(eng, p7E_ST_SVIT, t0, L);
+  p7_SparseForward (dsq, L, gm, eng->sm,  eng->sxf,          &(eng->fsc));   if (timer) t0 = engine_stage(eng, p7E_ST_SFWD, t0, L);
+  p7_SparseBackward(dsq, L, gm, eng->sm,  eng->sxd,          /*bsc=*/NULL);  if (timer) t0 = engine_stage(eng, p7E_ST_SBCK, t0, L);
+  p7_SparseDecoding(dsq, L, gm, eng->sxf, eng->sxd,          eng->sxd);      if (timer) t0 = engine_stage(eng, p7E_ST_SDEC, t0, L);
 
-  /* MPAS algorithm for finding the anchor set 
+  /* MPAS algorithm for finding the anchor set */
   p7_sparse_anchors_SetFromTrace(eng->sxd, eng->tr, eng->vanch);
   p7_trace_Reuse(eng->tr);
-  p7_sparse_Anchors(eng->rng, dsq, L, gm,
-		    eng->vsc, eng->fsc, eng->sxf, eng->sxd, eng->vanch,
-		    eng->tr, &(eng->wrkM), eng->ahash,  
-		    eng->asf, eng->anch, &(eng->asc_f), 
-		    mpas_params);
+
+  /* Fast path: if the Viterbi anchor set alone already has probability
+   * >= 1-loss_threshold, no other anchor set can beat it, and MPAS
+   * sampling can't change the answer. Many single-domain hits end
+   * here. Its ASC Forward is only worth doing when the decoded anchor
+   * cells say the test can pass; otherwise MPAS would just redo it.
+   */
+  if (! nmax_sampling && engine_anchorset_bound(eng->sxd, eng->vanch) >= 1.0 - loss_threshold)
+    p7_sparse_asc_Forward(dsq, L, gm, eng->vanch->a, eng->vanch->D, eng->sm, eng->asf, &vit_asc);
+
+  if (! nmax_sampling && expf(vit_asc - eng->fsc) >= 1.0 - loss_threshold)
+    {
+      p7_anchors_Copy(eng->vanch, eng->anch);
+      eng->asc_f = vit_asc;
+
+      if (eng->stats) 
+	{
+	  p7_mpas_stats_Init(&(eng->stats->mpas));
+	  eng->stats->mpas.has_part1            = TRUE;
+	  eng->stats->mpas.tot_iterations       = 0;
+	  eng->stats->mpas.tot_asc_calculations = 1;
+	  eng->stats->mpas.vsc                  = eng->vsc;
+	  eng->stats->mpas.fsc                  = eng->fsc;
+	  eng->stats->mpas.vit_asc              = vit_asc;
+	  eng->stats->mpas.vit_ascprob          = expf(vit_asc - eng->fsc);
+	  eng->stats->mpas.best_asc             = vit_asc;
+	  eng->stats->mpas.best_ascprob         = eng->stats->mpas.vit_ascprob;
+	  eng->stats->mpas.tot_prob             = eng->stats->mpas.vit_ascprob;
+	  eng->stats->mpas.nsamples_in_best     = 0;
+	  eng->stats->mpas.best_is_viterbi      = TRUE;
+	  eng->stats->n_mpas_fastpath++;
+	  eng->last_mpas_iter                   = 0;
+	}
+    }
+  else
+    {
+      if (eng->stats) p7_mpas_stats_Init(&(eng->stats->mpas));
+      p7_sparse_Anchors(eng->rng, dsq, L, gm,
+			eng->vsc, eng->fsc, eng->sxf, eng->sxd, eng->vanch,
+			eng->tr, &(eng->wrkM), eng->ahash,  
+			eng->asf, eng->anch, &(eng->asc_f), 
+			mpas_params, (eng->stats ? &(eng->stats->mpas) : NULL));
+
+      if (eng->stats)
+	{
+	  eng->last_mpas_iter = eng->stats->mpas.tot_iterations;
+	  eng->stats->n_mpas_sampled++;
+	}
+    }
+  if (timer) t0 = engine_stage(eng, p7E_ST_MPAS, t0, L);
 
   /* Remaining ASC calculations. MPAS already did <asf> for us. 
-  p7_sparse_asc_Backward(dsq, L, gm, eng->anch->a, eng->anch->D, eng->sm,    eng->asb, /*asc_b=NULL);
-  p7_sparse_asc_Decoding(dsq, L, gm, eng->anch->a, eng->anch->D, eng->asc_f, eng->asf, eng->asb, eng->asd);
+   * ASC Backward can't be decoded in place, so it needs a matrix of
+   * its own for a moment; but <sxf> isn't needed again until it
+   * becomes the AEC alignment matrix below, so we borrow it,
+   * rather than keeping a separate <asb> matrix around.
+   */
+  p7_sparsemx_Reuse(eng->sxf);                                      // sxf overwritten with ASC Backward matrix
+  p7_sparse_asc_Backward(dsq, L, gm, eng->anch->a, eng->anch->D, eng->sm,    eng->sxf, /*asc_b=*/NULL);
+  p7_sparse_asc_Decoding(dsq, L, gm, eng->anch->a, eng->anch->D, eng->asc_f, eng->asf, eng->sxf, eng->asd);
+  if (timer) t0 = engine_stage(eng, p7E_ST_ASC, t0, L);
 
-  /* Envelope determination 
+  /* Envelope determination */
   p7_sparse_Envelopes(dsq, L, gm, eng->anch->a, eng->anch->D, eng->asf, eng->asd, eng->env);
+  if (timer) t0 = engine_stage(eng, p7E_ST_ENV, t0, L);
 
   /* null2 score corrections on each envelope.
    * Store them in <env>: env->arr[d].null2_sc.     ($r_d$, in our print documentation)
-   
+   */
   p7_sparse_Null2(dsq, L, gm, eng->asd, eng->env, &(eng->wrkM), eng->wrkKp);
+  if (timer) t0 = engine_stage(eng, p7E_ST_NULL2, t0, L);
 
-  /* Optimal alignments for each envelope 
+  if (main_mode == p7E_DOMAINS) return eslOK;
+
+  /* Optimal alignments for each envelope */
   p7_sparsemx_Reuse(eng->sxf);                                      // sxf overwritten with AEC DP matrix
   p7_sparse_aec_Align(gm, eng->asd, eng->env, eng->sxf, eng->tr);
 
-  /* Pick up posterior probability annotation for the alignment 
+  /* Pick up posterior probability annotation for the alignment */
   p7_sparsemx_TracePostprobs(eng->sxd, eng->tr);
+  if (timer) engine_stage(eng, p7E_ST_AEC, t0, L);
+
+  return eslOK;
+}
+
+
+/* Function:  p7_engine_FindWindows()
+ * Synopsis:  Find SSV windows on a long target.
+ *
+ * Purpose:   For a long target sequence <dsq> of length <L>, find
+ *            the windows where the rest of the pipeline needs to
+ *            look, instead of running the Viterbi and Forward
+ *            filters and the main engine across the whole target.
+ *
+ *            The SSV filter collects high-scoring diagonals that
+ *            pass the F1 threshold in <wl>; these are then
+ *            extended by the expected lengths of the rest of the
+ *            model on either side (from <ssvdata>'s <prefix_lengths>
+ *            and <suffix_lengths>), and overlapping windows are
+ *            merged; see <p7_hmm_ExtendAndMergeWindows()>.
+ *
+ *            The caller then runs <p7_engine_Overthruster()> and
+ *            <p7_engine_Main()> on each window's subsequence,
+ *            <dsq + wl->windows[w].n - 1> of length
+ *            <wl->windows[w].length>, with the length models of
+ *            <om>, <bg>, and <gm> set to the window length, and
+ *            records any hit with <p7_engine_StoreHit()>, which
+ *            maps coordinates back onto the full target.
+ *
+ *            <ssvdata> must have its prefix and suffix lengths
+ *            calculated by <p7_hmm_ScoreDataComputeRest()>, and
+ *            <om->max_length> must be set.
+ *
+ * Args:      eng     - engine
+ *            dsq     - long target sequence, digital, 1..L
+ *            L       - length of <dsq>
+ *            om      - optimized profile, length model set for <L>
+ *            bg      - null model, length model set for <L>
+ *            ssvdata - SSV score data for <om>
+ *            wl      - initialized window list; RETURN: merged windows
+ *
+ * Returns:   <eslOK> if one or more windows were found.
+ *            <eslFAIL> if none were; <wl->count> is 0.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_engine_FindWindows(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_BG *bg, const P7_SCOREDATA *ssvdata, P7_HMM_WINDOWLIST *wl)
+{
+  int status;
+
+  wl->count = 0;
+  if (L == 0) return eslFAIL;
+
+  if ((status = p7_bg_NullOne(bg, dsq, L, &(eng->nullsc))) != eslOK) return status; 
+
+  status = p7_SSVFilter_longtarget(dsq, L, om, eng->fx, ssvdata, bg, eng->F1, wl);
+  if (status != eslOK) return status;
+  if (wl->count == 0)  return eslFAIL;
+
+  return p7_hmm_ExtendAndMergeWindows(om, ssvdata, wl, L, p7_ENGINE_WINDOW_OVERLAP);
+}
+#endif /*p7_ENGINE_KERNELS*/
+
+
+
+/* Function:  p7_engine_PredictMainCost()
+ * Synopsis:  Predict how much work <p7_engine_Main()> will do.
+ *
+ * Purpose:   After <p7_engine_Overthruster()> has returned <eslOK>,
+ *            predict the cost of running <p7_engine_Main()> on the
+ *            same comparison, in units of sparse DP supercells
+ *            computed. This lets a caller spot the rare target
+ *            (huge <L>, or a repetitive one whose sparse mask comes
+ *            out dense) that would take orders of magnitude longer
+ *            than usual, and schedule it separately.
+ *
+ *            Each pass of sparse DP costs time proportional to the
+ *            number of included supercells, <sm->ncells>, plus a
+ *            row of specials for each of the <sm->nrow + sm->S>
+ *            rows it touches. The number of passes depends on
+ *            <main_mode>: one (Forward) in <p7E_SCORES> mode; for
+ *            <p7E_DOMAINS>, Viterbi, Forward, Backward, and
+ *            Decoding, ASC Forward, Backward, and Decoding, and
+ *            envelope determination; plus AEC alignment in
+ *            <p7E_FULL>. Each anchor set that MPAS samples adds an
+ *            ASC Forward. If MPAS is set to sample all the way to
+ *            <max_iterations>, that's how many there are. Otherwise
+ *            the number is estimated from the filter scores: the best
+ *            single path (Viterbi filter score <vfsc>, or the MSV
+ *            score if the Viterbi filter was skipped) has posterior
+ *            probability about p = exp(vfsc - ffsc). The best anchor
+ *            set is at least that probable, and MPAS needs on the
+ *            order of 1/p samples to settle on it, so the estimate is
+ *            1/p - 1 samples, capped at <max_iterations>. It's zero
+ *            for a target with one dominant parse, where MPAS takes
+ *            the Viterbi anchor set without sampling, and large for
+ *            a long repetitive target whose Forward score is spread
+ *            over many parses.
+ *
+ * Returns:   predicted cost, in supercells.
+ */
+double
+p7_engine_PredictMainCost(const P7_ENGINE *eng)
+{
+  P7_MPAS_PARAMS *mpas_params    = (eng->params && eng->params->mpas_params ? eng->params->mpas_params : NULL);
+  int             main_mode      = (eng->params ? eng->params->main_mode : p7_ENGINE_MAIN_MODE);
+  int             nmax_sampling  = (mpas_params ? mpas_params->nmax_sampling  : p7_MPAS_NMAX_SAMPLING);
+  int             max_iterations = (mpas_params ? mpas_params->max_iterations : p7_MPAS_MAX_ITERATIONS);
+  float           pathsc         = (eng->vfsc > -eslINFINITY ? eng->vfsc : eng->mfsc);
+  double          spread         = (double) (eng->ffsc - pathsc);     // -log p(best path), nats
+  double          npasses;
+
+  if (main_mode == p7E_SCORES) npasses = 1.;
+  else
+    {
+      npasses = 8.;                                    // V, F, B, D; ASC F, B, D; envelopes
+      if (main_mode == p7E_FULL) npasses += 1.;        // AEC alignment
+      if      (nmax_sampling)                              npasses += (double) max_iterations;
+      else if (spread >= log((double) max_iterations + 1.)) npasses += (double) max_iterations;
+      else if (spread > 0.)                                npasses += exp(spread) - 1.;
+    }
+  return npasses * ((double) eng->sm->ncells + (double) (eng->sm->nrow + eng->sm->S));
+}
+
 
+
+
+/* Function:  p7_engine_StoreHit()
+ * Synopsis:  Record the engine's current result as a hit.
+ *
+ * Purpose:   Add a new hit to <th> for the comparison the engine
+ *            has just finished, on subsequence <subseq_start..subseq_start+window_length-1>
+ *            of target sequence number <seqidx>. Domain coordinates
+ *            in the engine are relative to the subsequence; in the
+ *            hit they are mapped back onto the full target. For a
+ *            whole sequence, pass <subseq_start=1> and
+ *            <window_length=L>.
+ *
+ *            The hit's <score>, <pre_score>, and <sortkey> are the
+ *            sparse Forward score in bits, relative to the bias
+ *            filter's null. The engine doesn't compute a
+ *            sequence-level null2 correction, so this score has none;
+ *            in <p7E_SCORES> mode, where no null2 is computed at all,
+ *            it is the only score the hit has.
+ *
+ *            Domains come from the engine's envelopes, with
+ *            null2-corrected <bitscore>s. Model coordinates
+ *            <ka..kb>, <kae..kbe> come from the AEC alignment, so
+ *            they are only set in <p7E_FULL> mode; otherwise they are
+ *            0. In <p7E_SCORES> mode there are no envelopes; the hit
+ *            gets one placeholder domain coordinate record spanning
+ *            the window (so hits can still be sorted by position), and
+ *            <ndom> is 0.
+ *
+ *            The caller sets the hit's <name>, <acc>, and <desc>, if
+ *            wanted.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_engine_StoreHit(P7_ENGINE *eng, int64_t seqidx, int64_t subseq_start, int window_length, P7_TOPHITS *th)
+{
+  P7_HIT  *hit     = NULL;
+  int      offset  = (int) (subseq_start - 1);
+  int      ndom    = (eng->env ? eng->env->D : 0);
+  int      is_full = ((eng->params ? eng->params->main_mode : p7_ENGINE_MAIN_MODE) == p7E_FULL);  // AEC has set model coords ka..kb
+  int      d;
+  int      status;
+
+  if ((status = p7_tophits_CreateNextHit(th, &hit)) != eslOK) return status;
+  if (eng->stats) eng->stats->n_hits++;
+
+  hit->seqidx        = seqidx;
+  hit->subseq_start  = subseq_start;
+  hit->window_length = window_length;
+  hit->score         = (eng->fsc - eng->biassc) / eslCONST_LOG2;
+  hit->pre_score     = hit->score;
+  hit->sortkey       = hit->score;
+  hit->ndom          = ndom;
+
+  if (( hit->dcl = p7_domain_Create(ESL_MAX(1, ndom))) == NULL) { status = eslEMEM; goto ERROR; }
+
+  if (ndom == 0)
+    {
+      hit->dcl[0].iae = hit->dcl[0].ia = offset + 1;
+      hit->dcl[0].ibe = hit->dcl[0].ib = offset + window_length;
+      hit->dcl[0].kae = hit->dcl[0].ka = 0;
+      hit->dcl[0].kbe = hit->dcl[0].kb = 0;
+    }
+  for (d = 0; d < ndom; d++)
+    {
+      hit->dcl[d].iae           = eng->env->arr[d+1].ia + offset;
+      hit->dcl[d].ibe           = eng->env->arr[d+1].ib + offset;
+      hit->dcl[d].ia            = eng->env->arr[d+1].ia + offset;
+      hit->dcl[d].ib            = eng->env->arr[d+1].ib + offset;
+      hit->dcl[d].kae           = (is_full ? eng->env->arr[d+1].ka : 0);
+      hit->dcl[d].kbe           = (is_full ? eng->env->arr[d+1].kb : 0);
+      hit->dcl[d].ka            = (is_full ? eng->env->arr[d+1].ka : 0);
+      hit->dcl[d].kb            = (is_full ? eng->env->arr[d+1].kb : 0);
+      hit->dcl[d].envsc         = eng->env->arr[d+1].env_sc;
+      hit->dcl[d].domcorrection = eng->env->arr[d+1].null2_sc;
+      hit->dcl[d].bitscore      = (eng->env->arr[d+1].env_sc - eng->env->arr[d+1].null2_sc - eng->biassc) / eslCONST_LOG2;
+    }
   return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_engine_RecordLatency()
+ * Synopsis:  Record how long the comparison just finished took.
+ *
+ * Purpose:   If <eng> is recording latencies (its params'
+ *            <do_latency> flag, into <eng->stats>), add the wall
+ *            clock time since the Overthruster started on the current comparison to the
+ *            latency histogram, and offer it to the list of slowest
+ *            comparisons, with target sequence number <seqidx> and
+ *            subsequence start <subseq_start> (1 for a whole
+ *            sequence) to identify it. Otherwise, do nothing.
+ *
+ *            Latency is per engine comparison: windows and split
+ *            pieces of a long target are recorded separately, and
+ *            the SSV scan that finds windows isn't counted in any
+ *            of them. Call this after the Overthruster, and Main if
+ *            it ran, but before <p7_engine_Reuse()>, which forgets
+ *            the start time.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_engine_RecordLatency(P7_ENGINE *eng, int64_t seqidx, int64_t subseq_start)
+{
+  P7_ENGINE_STATS  *stats = eng->stats;
+  P7_ENGINE_SLOWSEQ sl;
+  uint64_t          ns;
+
+  if (! stats || ! eng->params || ! eng->params->do_latency || ! eng->lat_t0) return eslOK;
+
+  ns = engine_clock() - eng->lat_t0;
+  stats->lat_hist[engine_latbin(ns)]++;
+  stats->lat_n++;
+  stats->lat_total += ns;
+  stats->lat_max    = ESL_MAX(stats->lat_max, ns);
+
+  sl.seqidx       = seqidx;
+  sl.subseq_start = subseq_start;
+  sl.L            = eng->last_L;
+  sl.stage        = eng->last_stage;
+  sl.ncells       = eng->last_ncells;
+  sl.mpas_iter    = eng->last_mpas_iter;
+  sl.ns           = ns;
+  engine_slowinsert(stats, &sl);
+
+  eng->lat_t0 = 0;
+  return eslOK;
+}
+/*****************************************************************
+ * x. Benchmark driver: cells/sec for each DP kernel
+ *****************************************************************/
+#ifdef p7ENGINE_BENCHMARK
+/* 
+   gcc -O3 -std=gnu99 -o p7_engine_benchmark -I. -L. -I../easel -L../easel -Dp7_ENGINE_KERNELS -Dp7ENGINE_BENCHMARK p7_engine.c p7_memgov.c p7_checkptmx.c p7_scoredata.c -lhmmer -leasel -lm -lpthread
+   ./p7_engine_benchmark > bench.tsv
+
+   For each model length M in a sweep (default 50..3000), samples a
+   random model with p7_modelsample() and times each DP kernel on <N>
+   targets: i.i.d. background sequences of length <L>, or with --emit,
+   sequences emitted from the profile (length model set to <L>).
+   
+   The vector filters are timed on the whole M x L matrix. The
+   checkpointed Forward/Backward filters run as a pair, as in the
+   Overthruster, and are reported separately. The sparse kernels are
+   timed on a full sparse mask (every cell included), which is their
+   worst case and makes cells comparable with the filters.
+
+   Output is one tab-delimited line per (kernel, M), starting with the
+   SIMD backend the binary was built for, so files from different
+   builds and CPUs can be concatenated and compared:
+      backend kernel M L N cells sec Gcells/s ns/cell est_cycles/cell
+   est_cycles/cell is an estimate from the nominal clock rate given
+   by --ghz, not a measured cycle count (turbo and frequency scaling
+   make it inexact); without --ghz it's NA. Cache miss rates aren't measured here; run
+   under `perf stat -e cache-misses` for those.
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+
+#if   defined(eslENABLE_AVX512)
+#define BENCH_BACKEND "avx512"
+#elif defined(eslENABLE_AVX)
+#define BENCH_BACKEND "avx"
+#elif defined(eslENABLE_SSE)
+#define BENCH_BACKEND "sse"
+#elif defined(eslENABLE_NEON)
+#define BENCH_BACKEND "neon"
+#else
+#define BENCH_BACKEND "unknown"
+#endif
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,      "0", NULL, NULL,      NULL,      NULL,    NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0",     NULL,      NULL,    NULL, "length of target seqs",                          0 },
+  { "-N",        eslARG_INT,    "100", NULL, "n>0",     NULL,      NULL,    NULL, "number of target seqs",                          0 },
+  { "--M",       eslARG_STRING, NULL,  NULL, NULL,      NULL,      NULL,    NULL, "comma-separated model lengths to sweep",         0 },
+  { "--emit",    eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "emit targets from the profile, not i.i.d.",      0 },
+  { "--ghz",     eslARG_REAL,    "0.", NULL, "x>=0",    NULL,      NULL,    NULL, "CPU clock in GHz, to estimate cycles/cell",      0 },
+  { "--nosparse",eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "skip the sparse kernels (they're slow at large M)", 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "cells/sec benchmark of each DP kernel in the engine";
+
+enum bench_kernel_e { B_SSV, B_MSV, B_VIT, B_FWDF, B_BCKF, B_SVIT, B_SFWD, B_SBCK, B_SDEC, B_NKERNELS };
+static char *kernelname[B_NKERNELS] = { "ssv", "msv", "vitfilter", "fwdfilter", "bckfilter", "sparse_vit", "sparse_fwd", "sparse_bck", "sparse_dec" };
+
+static void
+bench_report(int k, int M, int L, int N, double cells, double sec, double ghz)
+{
+  printf("%s\t%s\t%d\t%d\t%d\t%.0f\t%.6f\t%.4f\t%.4f\t",
+	 BENCH_BACKEND, kernelname[k], M, L, N, cells, sec, cells / sec * 1e-9, sec * 1e9 / cells);
+  if (ghz > 0.) printf("%.4f\n", sec * ghz * 1e9 / cells);
+  else          printf("NA\n");
 }
-*/
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *rng     = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg      = p7_bg_Create(abc);
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  double          ghz     = esl_opt_GetReal(go, "--ghz");
+  int             do_sparse = (esl_opt_GetBoolean(go, "--nosparse") ? FALSE : TRUE);
+  int             Mdefault[] = { 50, 100, 200, 400, 800, 1200, 1600, 2000, 2500, 3000 };
+  int            *Mlist   = Mdefault;
+  int             nM      = sizeof(Mdefault) / sizeof(int);
+  char           *Mstr    = NULL;
+  char           *tok;
+  ESL_DSQ       **dsq     = NULL;
+  int            *len     = NULL;
+  ESL_SQ         *sq      = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_FILTERMX    *fx      = NULL;
+  P7_CHECKPTMX   *cx      = NULL;
+  P7_SPARSEMASK  *sm      = NULL;
+  P7_SPARSEMX    *sxf     = NULL;
+  P7_SPARSEMX    *sxb     = NULL;
+  P7_SPARSEMX    *sxd     = NULL;
+  P7_TRACE       *tr      = NULL;
+  double          fcells, scells;
+  double          tf, tb;
+  double          tt[B_NKERNELS];
+  float           sc;
+  int             i, m, M;
+  int             status;
+
+  if (esl_opt_IsOn(go, "--M"))
+    {
+      esl_strdup(esl_opt_GetString(go, "--M"), -1, &Mstr);
+      ESL_ALLOC(Mlist, sizeof(int) * (strlen(Mstr) / 2 + 1));
+      for (nM = 0, tok = strtok(Mstr, ","); tok; tok = strtok(NULL, ","))
+	if ((Mlist[nM++] = atoi(tok)) <= 0) esl_fatal("bad model length in --M: %s", tok);
+    }
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ *) * N);
+  ESL_ALLOC(len, sizeof(int)       * N);
+  for (i = 0; i < N; i++) dsq[i] = NULL;
+  sq = esl_sq_CreateDigital(abc);
+
+  printf("# backend\tkernel\tM\tL\tN\tcells\tsec\tGcells/s\tns/cell\test_cycles/cell\n");
+  for (m = 0; m < nM; m++)
+    {
+      M = Mlist[m];
+      if (p7_modelsample(rng, M, abc, &hmm) != eslOK) esl_fatal("failed to sample an HMM");
+      gm = p7_profile_Create (M, abc);
+      om = p7_oprofile_Create(M, abc);
+      p7_profile_Config(gm, hmm, bg);
+      p7_oprofile_Convert(gm, om);
+      p7_profile_SetLength(gm, L);
+
+      /* Targets for this model. Emitted ones vary in length. */
+      for (fcells = 0., i = 0; i < N; i++)
+	{
+	  if (esl_opt_GetBoolean(go, "--emit"))
+	    {
+	      do {
+		esl_sq_Reuse(sq);
+		p7_ProfileEmit(rng, hmm, gm, bg, sq, NULL);
+	      } while (sq->n == 0);
+	      len[i] = (int) sq->n;
+	      ESL_REALLOC(dsq[i], sizeof(ESL_DSQ) * (len[i]+2));
+	      memcpy(dsq[i], sq->dsq, sizeof(ESL_DSQ) * (len[i]+2));
+	    }
+	  else
+	    {
+	      len[i] = L;
+	      ESL_REALLOC(dsq[i], sizeof(ESL_DSQ) * (L+2));
+	      esl_rsq_xfIID(rng, bg->f, abc->K, L, dsq[i]);
+	    }
+	  fcells += (double) M * (double) len[i];
+	}
+
+      fx  = p7_filtermx_Create(M);
+      cx  = p7_checkptmx_Create(M, L, ESL_MBYTES(p7_SPARSIFY_RAMLIMIT));
+      sm  = p7_sparsemask_Create(M, L);
+
+      esl_stopwatch_Start(w);
+      for (i = 0; i < N; i++) { p7_oprofile_ReconfigLength(om, len[i]); p7_SSVFilter(dsq[i], len[i], om, &sc); }
+      esl_stopwatch_Stop(w);
+      bench_report(B_SSV, M, L, N, fcells, esl_stopwatch_GetElapsed(w), ghz);
+
+      esl_stopwatch_Start(w);
+      for (i = 0; i < N; i++) { p7_oprofile_ReconfigLength(om, len[i]); p7_MSVFilter(dsq[i], len[i], om, fx, &sc); p7_filtermx_Reuse(fx); }
+      esl_stopwatch_Stop(w);
+      bench_report(B_MSV, M, L, N, fcells, esl_stopwatch_GetElapsed(w), ghz);
+
+      esl_stopwatch_Start(w);
+      for (i = 0; i < N; i++) { p7_oprofile_ReconfigLength(om, len[i]); p7_ViterbiFilter(dsq[i], len[i], om, fx, &sc); p7_filtermx_Reuse(fx); }
+      esl_stopwatch_Stop(w);
+      bench_report(B_VIT, M, L, N, fcells, esl_stopwatch_GetElapsed(w), ghz);
+
+      /* Backward filter needs its Forward; time them separately in one pass */
+      for (tf = tb = 0., i = 0; i < N; i++) 
+	{
+	  p7_oprofile_ReconfigLength(om, len[i]);
+	  esl_stopwatch_Start(w);
+	  p7_ForwardFilter(dsq[i], len[i], om, cx, &sc);
+	  esl_stopwatch_Stop(w);
+	  tf += esl_stopwatch_GetElapsed(w);
+
+	  esl_stopwatch_Start(w);
+	  p7_BackwardFilter(dsq[i], len[i], om, cx, sm, p7_SPARSIFY_THRESH);
+	  esl_stopwatch_Stop(w);
+	  tb += esl_stopwatch_GetElapsed(w);
+
+	  p7_checkptmx_Reuse(cx);
+	  p7_sparsemask_Reuse(sm);
+	}
+      bench_report(B_FWDF, M, L, N, fcells, tf, ghz);
+      bench_report(B_BCKF, M, L, N, fcells, tb, ghz);
+
+      if (do_sparse)
+	{
+	  sxf = p7_sparsemx_Create(NULL);
+	  sxb = p7_sparsemx_Create(NULL);
+	  sxd = p7_sparsemx_Create(NULL);
+	  tr  = p7_trace_Create();
+
+	  for (i = 0; i < B_NKERNELS; i++) tt[i] = 0.;
+	  for (scells = 0., i = 0; i < N; i++)
+	    {
+	      p7_profile_SetLength(gm, len[i]);
+	      p7_sparsemask_Reinit(sm, M, len[i]);
+	      p7_sparsemask_AddAll(sm);
+	      scells += (double) sm->ncells;
+
+	      esl_stopwatch_Start(w); p7_SparseViterbi (dsq[i], len[i], gm, sm, sxf, tr, &sc);   esl_stopwatch_Stop(w); tt[B_SVIT] += esl_stopwatch_GetElapsed(w);
+	      p7_sparsemx_Reuse(sxf);
+	      esl_stopwatch_Start(w); p7_SparseForward (dsq[i], len[i], gm, sm, sxf, &sc);       esl_stopwatch_Stop(w); tt[B_SFWD] += esl_stopwatch_GetElapsed(w);
+	      esl_stopwatch_Start(w); p7_SparseBackward(dsq[i], len[i], gm, sm, sxb, &sc);       esl_stopwatch_Stop(w); tt[B_SBCK] += esl_stopwatch_GetElapsed(w);
+	      esl_stopwatch_Start(w); p7_SparseDecoding(dsq[i], len[i], gm, sxf, sxb, sxd);      esl_stopwatch_Stop(w); tt[B_SDEC] += esl_stopwatch_GetElapsed(w);
+
+	      p7_sparsemx_Reuse(sxf);
+	      p7_sparsemx_Reuse(sxb);
+	      p7_sparsemx_Reuse(sxd);
+	      p7_sparsemask_Reuse(sm);
+	      p7_trace_Reuse(tr);
+	    }
+	  bench_report(B_SVIT, M, L, N, scells, tt[B_SVIT], ghz);
+	  bench_report(B_SFWD, M, L, N, scells, tt[B_SFWD], ghz);
+	  bench_report(B_SBCK, M, L, N, scells, tt[B_SBCK], ghz);
+	  bench_report(B_SDEC, M, L, N, scells, tt[B_SDEC], ghz);
+
+	  p7_trace_Destroy(tr);
+	  p7_sparsemx_Destroy(sxd);
+	  p7_sparsemx_Destroy(sxb);
+	  p7_sparsemx_Destroy(sxf);
+	}
+      fflush(stdout);
+
+      p7_sparsemask_Destroy(sm);
+      p7_checkptmx_Destroy(cx);
+      p7_filtermx_Destroy(fx);
+      p7_oprofile_Destroy(om);
+      p7_profile_Destroy(gm);
+      p7_hmm_Destroy(hmm);
+    }
+
+  for (i = 0; i < N; i++) free(dsq[i]);
+  free(dsq);
+  free(len);
+  if (Mlist != Mdefault) free(Mlist);
+  if (Mstr) free(Mstr);
+  esl_sq_Destroy(sq);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_stopwatch_Destroy(w);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ ERROR:
+  esl_fatal("allocation failed");
+}
+#endif /*p7ENGINE_BENCHMARK*/
+/*------------------ end, benchmark -----------------------------*/
+
+
 /*****************************************************************
  * x. Example
  *****************************************************************/
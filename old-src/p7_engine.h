@@ -22,10 +22,101 @@
 
 #include "p7_sparsemx.h"
 
+#include "p7_memgov.h"
+
+#include "p7_hmmwindow.h"
+#include "p7_scoredata.h"
+#include "p7_tophits.h"
+
 #include "p7_mpas.h"
 
 
 
+/* How far p7_engine_Main() goes, in P7_ENGINE_PARAMS <main_mode>. 
+ * Each mode does a subset of the work of the one below it.
+ */
+enum p7e_mode_e {
+  p7E_FULL    = 0,   // scores, envelopes, null2 corrections, and alignments
+  p7E_SCORES  = 1,   // sparse Forward score only
+  p7E_DOMAINS = 2,   // scores, anchors, envelopes, and null2 corrections; no alignments
+};
+
+/* Stages of the engine, for per-stage timing in P7_ENGINE_STATS.
+ */
+enum p7e_stage_e {
+  p7E_ST_NULL  = 0,   // null model score
+  p7E_ST_MSV   = 1,   // MSV filter
+  p7E_ST_BIAS  = 2,   // bias filter
+  p7E_ST_VIT   = 3,   // Viterbi filter
+  p7E_ST_FWD   = 4,   // checkpointed Forward filter
+  p7E_ST_BCK   = 5,   // checkpointed Backward filter, decoding, and sparsification
+  p7E_ST_SVIT  = 6,   // sparse Viterbi
+  p7E_ST_SFWD  = 7,   // sparse Forward
+  p7E_ST_SBCK  = 8,   // sparse Backward
+  p7E_ST_SDEC  = 9,   // sparse Decoding
+  p7E_ST_MPAS  = 10,  // anchor set: Viterbi fast path test, or MPAS sampling
+  p7E_ST_ASC   = 11,  // ASC Backward and Decoding
+  p7E_ST_ENV   = 12,  // envelope determination
+  p7E_ST_NULL2 = 13,  // null2 score corrections
+  p7E_ST_AEC   = 14,  // AEC alignment and its posterior annotation
+};
+#define p7E_NSTAGES 15
+
+/* Hardware event counters, for per-stage counts in P7_ENGINE_STATS.
+ */
+enum p7e_counter_e {
+  p7E_CTR_CYCLES  = 0,   // CPU cycles
+  p7E_CTR_INSTR   = 1,   // instructions retired
+  p7E_CTR_L1DMISS = 2,   // L1 data cache read misses
+  p7E_CTR_LLCMISS = 3,   // last level cache read misses
+  p7E_CTR_BRMISS  = 4,   // branch mispredictions
+};
+#define p7E_NCTRS 5
+
+/* Sparse mask density, ncells/(L*M), is histogrammed in half-decade
+ * bins: bin 0 is < 1e-5, and bin b>0 is [10^((b-11)/2), 10^((b-10)/2)),
+ * with the last bin also taking density 1.
+ */
+#define p7E_NDENSBINS 11
+
+/* DP structures whose sizes P7_ENGINE_STATS can track.
+ */
+enum p7e_mem_e {
+  p7E_MEM_FX    = 0,   // filter matrix <fx>
+  p7E_MEM_CX    = 1,   // checkpointed matrix <cx>
+  p7E_MEM_SM    = 2,   // sparse mask <sm>
+  p7E_MEM_SXF   = 3,   // sparse matrices <sxf>, <sxd>, <asf>, <asd>
+  p7E_MEM_SXD   = 4,
+  p7E_MEM_ASF   = 5,
+  p7E_MEM_ASD   = 6,
+  p7E_MEM_AHASH = 7,   // MPAS anchor set hash <ahash>
+};
+#define p7E_NMEM 8
+
+/* Comparison latencies are histogrammed in log buckets, HDR style:
+ * each power of two nanoseconds is split into p7E_LATSUB linear
+ * sub-buckets, so a bucket is within 1/p7E_LATSUB (12.5%) of any
+ * value in it, over the whole range of a uint64_t.
+ */
+#define p7E_LATSUBBITS 3
+#define p7E_LATSUB     (1 << p7E_LATSUBBITS)
+#define p7E_NLATBINS   ((64 - p7E_LATSUBBITS + 1) * p7E_LATSUB)
+
+#define p7E_NSLOW      20   // # of slowest comparisons P7_ENGINE_STATS keeps
+
+/* P7_ENGINE_SLOWSEQ
+ * One of the slowest comparisons, in P7_ENGINE_STATS.
+ */
+typedef struct {
+  int64_t  seqidx;        // target sequence index, as given to p7_engine_RecordLatency()
+  int64_t  subseq_start;  //   ... and start of the subsequence compared; 1 for a whole sequence
+  int      L;             // length of the subsequence
+  int      stage;         // last engine stage it reached (p7e_stage_e)
+  int64_t  ncells;        // sparse mask cells; 0 if it didn't pass the filters
+  int      mpas_iter;     // MPAS sampling iterations; 0 on the Viterbi fast path, -1 if it didn't get that far
+  uint64_t ns;            // wall clock time, ns
+} P7_ENGINE_SLOWSEQ;
+
 /* P7_ENGINE_PARAMS 
  * Configuration/control settings for the Engine.
  */
@@ -33,8 +124,17 @@ typedef struct p7_engine_params_s {
   uint32_t rng_seed;           // random number generator seed. >0 for specific, reproducible seed; 0=random seed. Default = 42.
   int      rng_reproducible;   // TRUE to reseed RNG at every comparison, enabling reproducible results.
   int      sparsify_ramlimit;  // Memory redline for checkpointed decoding, in MB. Default = p7_SPARSIFY_RAMLIMIT [p7_config.h]
+  int      cache_nthreads;     // If >0, size checkpointed decoding to fit a per-thread cache share instead, with this many threads. Default = p7_ENGINE_CACHE_NTHREADS
   float    sparsify_thresh;    // (i,k) supercell included in sparsemask if pp>this probability, 0<=x<1. Default = p7_SPARSIFY_THRESH [p7_config.h]
+  int64_t  sparsify_maxcells;  // if >0, raise the threshold until the sparsemask has <= this many cells. Default = p7_SPARSIFY_MAXCELLS
+  int      sparsify_maxrow;    // if >0, ... and no more than this many on any row. Default = p7_SPARSIFY_MAXROW
   int      do_biasfilter;      // TRUE to use ad hoc "bias filter" after MSV/SSV step
+  int      main_mode;          // p7E_FULL | p7E_SCORES | p7E_DOMAINS. Default = p7_ENGINE_MAIN_MODE [p7_config.h]
+
+  int      do_timing;          // TRUE to time each stage in the engine's <stats>. FALSE (the default) costs one test per stage.
+  int      do_counters;        // TRUE to count hardware events in each stage (Linux perf_event). Stages are timed too.
+  int      do_memory;          // TRUE to sample the size of each DP structure at every p7_engine_Reuse()
+  int      do_latency;         // TRUE to record comparison latencies; see p7_engine_RecordLatency()
 
   P7_MPAS_PARAMS *mpas_params;  // optional config/control parameters for MPAS algorithm; or NULL for defaults
 
@@ -45,14 +145,85 @@ typedef struct p7_engine_params_s {
  * Statistics collection for the Engine.
  */
 typedef struct p7_engine_stats_s {
-  int n_past_msv;
-  int n_past_bias;
-  int n_ran_vit;
-  int n_past_vit;
-  int n_past_fwd;
+  int64_t n_seqs;         // # of comparisons started in the Overthruster
+  int64_t n_past_msv;
+  int64_t n_past_bias;
+  int64_t n_ran_vit;
+  int64_t n_f2_shortcut;  // # past bias that skipped the Viterbi filter, because MSV already satisfied F2
+  int64_t n_past_vit;
+  int64_t n_past_fwd;
+
+  int64_t res_seqs;       // total residues in those comparisons
+  int64_t res_past_msv;   //   ... and in those passing each filter
+  int64_t res_past_bias;
+  int64_t res_past_vit;
+  int64_t res_past_fwd;
 
+  int64_t density_hist[p7E_NDENSBINS];  // histogram of sparse mask density, ncells/(L*M), for comparisons past Forward
+
+  int64_t n_main;         // # of p7_engine_Main() comparisons
+  int64_t n_hits;         // # of hits stored by p7_engine_StoreHit()
+
+  int64_t n_mpas_fastpath;    // # of main engine comparisons where the Viterbi anchor set was decisive, and MPAS sampling was skipped
+  int64_t n_mpas_sampled;     // # of main engine comparisons that ran MPAS sampling
+
+  P7_MPAS_STATS mpas;     // MPAS stats for the most recent main engine comparison; has_part1 is only set on the fast path
+
+  int64_t n_mem_fallback;     // # of Forward/Backward filter runs that fell back to a minimal checkpointed matrix, under a memory governor
+  int64_t n_mem_deferred;     // # of comparisons given up (eslENORESULT) because the memory governor refused a reservation
+
+  int64_t n_sparsify_raised;       // # of comparisons where the sparsify threshold was raised to meet the cell budget
+  int64_t sparsify_cells_dropped;  // total # of sparsemask cells that raising the threshold dropped
+  double  sparsify_lost;           // upper bound on total posterior mass in those dropped cells
+
+  uint64_t stage_ns   [p7E_NSTAGES];  // total wall clock time in each stage, nanoseconds
+  int64_t  stage_calls[p7E_NSTAGES];  // # of times each stage ran
+  int64_t  stage_res  [p7E_NSTAGES];  // total # of residues each stage processed
+
+  uint64_t stage_ctr[p7E_NSTAGES][p7E_NCTRS];   // total events counted in each stage
+  int      ctr_avail[p7E_NCTRS];                // TRUE if counter could be opened
+
+  int64_t  mem_cur        [p7E_NMEM];   // bytes held by each structure at the end of the last comparison
+  int64_t  mem_peak       [p7E_NMEM];   // high-water mark of each
+  int      mem_peak_L     [p7E_NMEM];   //   ... L of the comparison that set it
+  int      mem_peak_M     [p7E_NMEM];   //   ... M
+  int64_t  mem_peak_ncells[p7E_NMEM];   //   ... and its sparse mask cells
+  int64_t  mem_ngrow      [p7E_NMEM];   // # of comparisons that left the structure bigger than before
+  int64_t  mem_total_peak;              // high-water mark of all of them together
+  int      mem_total_peak_L;
+  int      mem_total_peak_M;
+  int64_t  mem_total_peak_ncells;
+  int64_t  sm_krealloc;                 // the sparse mask's own reallocation counts (n_krealloc, etc.), at the last sample
+  int64_t  sm_rrealloc;
+  int64_t  sm_srealloc;
+
+  int64_t  lat_hist[p7E_NLATBINS];      // histogram of latencies, log buckets (see engine_latbin())
+  int64_t  lat_n;                       // # of comparisons recorded
+  uint64_t lat_total;                   //   ... their total time, ns
+  uint64_t lat_max;                     //   ... and the longest one's
+  P7_ENGINE_SLOWSEQ slow[p7E_NSLOW];    // the slowest comparisons, in no particular order
+  int      nslow;                       // # of them in <slow>, up to p7E_NSLOW
 } P7_ENGINE_STATS;
 
+/* P7_ENGINE_FILTERED
+ * What p7_engine_Overthruster() leaves for p7_engine_Main(): the
+ * sparse mask and the filter scores, taken out of an engine so that
+ * the main engine can run on them later, maybe on another engine.
+ * See p7_engine_DetachFiltered().
+ */
+typedef struct p7_engine_filtered_s {
+  P7_SPARSEMASK  *sm;        // sparse mask
+  float           nullsc;    // filter scores, as in P7_ENGINE
+  float           biassc;
+  float           mfsc;
+  float           vfsc;
+  float           ffsc;
+  float           sm_thresh; // sparsify threshold <sm> was built with
+  float           sm_lost;   //   ... and the posterior mass bound on what raising it dropped
+  int             L;         // length of the target
+  uint64_t        lat_ns;    // time spent on the comparison so far, if the engine is recording latencies
+} P7_ENGINE_FILTERED;
+
 /* P7_ENGINE
  * The Engine.
  */
@@ -63,11 +234,12 @@ typedef struct p7_engine_s {
   P7_CHECKPTMX   *cx;     // Checkpointed vector local F/B/D matrix.     O(M \sqrt L) mem.  (p7_SPARSIFY_RAMLIMIT = 128M)
   P7_SPARSEMASK  *sm;     // Sparse mask.                                O(L) mem. 
 
-  int       used_main;    // if TRUE, main engine was used and these structures need to be Reuse()'d:
-  P7_SPARSEMX    *sxf;    // Sparse Forward matrix                       O(L)
+  int       used_main;    // if TRUE, main engine was used and these structures need to be Reuse()'d.
+                          // In p7E_SCORES mode, only <sxf> is allocated; the rest are NULL.
+                          // In p7E_DOMAINS mode, <tr> is only used for Viterbi and MPAS traces.
+  P7_SPARSEMX    *sxf;    // Sparse Forward matrix (also, in turn, ASC Backward and AEC alignment) O(L)
   P7_SPARSEMX    *sxd;    // Sparse Decoding (also briefly Backward)     O(L)
   P7_SPARSEMX    *asf;    // ASC Sparse Forward mx
-  P7_SPARSEMX    *asb;    // ASC Sparse Backward mx  (could be optimized away, but current impl can't decode while overwriting <asb>)
   P7_SPARSEMX    *asd;    // ASC Sparse Decoding mx
   P7_ANCHORS     *vanch;  // Initial anchor set implied by the Viterbi parse
   P7_ANCHORS     *anch;   // Anchor set optimized by MPAS
@@ -87,10 +259,30 @@ typedef struct p7_engine_s {
   float           fsc;    // sparse Forward score
   float           asc_f;  // ASC Forward score, s^A_f
 
+  float           sm_thresh; // sparsify threshold that <sm> was actually built with
+  float           sm_lost;   // upper bound on posterior mass dropped from <sm> by raising it; 0 if not raised
+
   float           F1;
   float           F2;
   float           F3;
 
+  P7_MEMGOV      *mg;          // optional shared memory governor, or NULL. A reference; the engine doesn't free it.
+  int64_t         mg_held;     // bytes this engine has reserved from <mg>
+  int64_t         cx_ramlimit; // <cx->ramlimit> as created; restored after a governor fallback
+
+  int             last_L;         // L of the current comparison, for <stats> memory and latency records
+  int64_t         last_ncells;    //   ... its sparse mask cells, or 0 if it didn't get that far
+  int             last_stage;     //   ... the last stage it reached
+  int             last_mpas_iter; //   ... and its MPAS iterations, or -1 if it didn't get to MPAS
+  uint64_t        lat_t0;         // clock at the start of the current comparison, if <params->do_latency>; 0 if none is open
+
+  int             ctr_state;             // hardware counters for <params->do_counters>: 0 = not opened yet; 1 = open; -1 = unavailable
+  int             ctr_fd   [p7E_NCTRS];  // perf event fds; ctr_fd[0] leads the group. -1 if not open.
+  int             ctr_slot [p7E_NCTRS];  // position of each counter in a group read; -1 if not open
+  int             ctr_n;                 // # of counters open
+  long            ctr_tid;               // thread the counters count; they're reopened if the engine moves
+  uint64_t        ctr_last [p7E_NCTRS];  // counter values at the start of the current stage
+
   P7_ENGINE_PARAMS *params; // config/control parameters for the Engine
   P7_ENGINE_STATS  *stats;  // optional stats collection for the Engine, or NULL
 } P7_ENGINE;
@@ -99,15 +291,31 @@ extern P7_ENGINE_PARAMS *p7_engine_params_Create (P7_MPAS_PARAMS *mpas_params);
 extern void              p7_engine_params_Destroy(P7_ENGINE_PARAMS *prm);
 
 extern P7_ENGINE_STATS  *p7_engine_stats_Create(void);
+extern int               p7_engine_stats_Merge  (P7_ENGINE_STATS *dst, const P7_ENGINE_STATS *src);
+extern int               p7_engine_stats_Dump   (FILE *ofp, const P7_ENGINE_STATS *stats);
+extern int               p7_engine_stats_DumpMemory(FILE *ofp, const P7_ENGINE_STATS *stats);
+extern int               p7_engine_stats_DumpLatency(FILE *ofp, const P7_ENGINE_STATS *stats);
 extern void              p7_engine_stats_Destroy(P7_ENGINE_STATS *prm);
 
 extern P7_ENGINE *p7_engine_Create (const ESL_ALPHABET *abc, P7_ENGINE_PARAMS *prm, P7_ENGINE_STATS *stats, int M_hint, int L_hint);
 extern int        p7_engine_Reuse  (P7_ENGINE *eng);
 extern void       p7_engine_Destroy(P7_ENGINE *eng);
 
+extern int        p7_engine_SetMemGovernor(P7_ENGINE *eng, P7_MEMGOV *mg);
+
+extern int        p7_engine_DetachFiltered(P7_ENGINE *eng, P7_ENGINE_FILTERED **ret_flt);
+extern int        p7_engine_AttachFiltered(P7_ENGINE *eng, P7_ENGINE_FILTERED *flt);
+extern void       p7_engine_filtered_Destroy(P7_ENGINE_FILTERED *flt);
+
 extern int p7_engine_Overthruster(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_BG *bg);
 extern int p7_engine_Main        (P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_PROFILE  *gm);
 
+extern double p7_engine_PredictMainCost(const P7_ENGINE *eng);
+
+extern int p7_engine_FindWindows(P7_ENGINE *eng, ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_BG *bg, const P7_SCOREDATA *ssvdata, P7_HMM_WINDOWLIST *wl);
+extern int p7_engine_StoreHit   (P7_ENGINE *eng, int64_t seqidx, int64_t subseq_start, int window_length, P7_TOPHITS *th);
+extern int p7_engine_RecordLatency(P7_ENGINE *eng, int64_t seqidx, int64_t subseq_start);
+
 #endif /*p7ENGINE_INCLUDED*/
 /*****************************************************************
  * @LICENSE@
@@ -4,13 +4,16 @@
  * Contents:
  *   1. The P7_FILTERMX object
  *   2. Debugging and development routines
- *   3. Copyright and license information
+ *   3. Unit tests
+ *   4. Test driver
+ *   5. Copyright and license information
  */
 
 #include "p7_config.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 
 #include "easel.h"
@@ -398,6 +401,254 @@ ERROR:
 #endif /*p7_DEBUGGING*/
 
 
+/* dumpline_nvalues()
+ * Count the whitespace-delimited fields in <s>.
+ */
+static int
+dumpline_nvalues(const char *s)
+{
+  int n = 0;
+
+  while (*s)
+    {
+      while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') s++;
+      if (! *s) break;
+      n++;
+      while (*s && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r') s++;
+    }
+  return n;
+}
+
+/* Function:  p7_filtermx_CompareDumps()
+ * Synopsis:  Compare two filter DP dumps, cell by cell.
+ *
+ * Purpose:   Read two diagnostic dumps <afp> and <bfp> of the same
+ *            calculation, as written by <p7_filtermx_DumpMFRow()> or
+ *            <p7_filtermx_DumpVFRow()>, and compare every cell. A file
+ *            may hold many dumps, one per target sequence, as long as
+ *            both files hold them in the same order. Two cells match
+ *            if their values differ by no more than <tol>. Two
+ *            correct implementations of a filter (on different SIMD
+ *            backends, say) should give identical cells, so <tol> is
+ *            usually 0.
+ *
+ *            If <ofp> is non-NULL, report the first <maxshow>
+ *            mismatching cells to it, one per line: which dump, row
+ *            <i>, state (M, I, D), column (<k>, or one of the
+ *            specials E N J B C), and the two values.
+ *
+ *            Optionally return the number of cells compared in
+ *            <*opt_ncells>, and the number that didn't match in
+ *            <*opt_ndiff>.
+ *
+ *            This only parses text, so unlike the dump routines
+ *            themselves it doesn't need a <p7_DEBUGGING> build.
+ *
+ * Returns:   <eslOK> if every cell matches.
+ *
+ *            <eslFAIL> if some cells differ by more than <tol>.
+ *
+ *            <eslEFORMAT> if the dumps don't have the same shape
+ *            (a different number of dumps, rows, or columns), so
+ *            their cells can't be paired up. The line where they
+ *            diverge is reported to <ofp>, and the counts cover only
+ *            what was compared before it.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_filtermx_CompareDumps(FILE *afp, FILE *bfp, int tol, FILE *ofp, int maxshow, int64_t *opt_ncells, int64_t *opt_ndiff)
+{
+  static char *xname[5] = { "E", "N", "J", "B", "C" };
+  char    *abuf   = NULL;
+  char    *bbuf   = NULL;
+  int      an     = 0;
+  int      bn     = 0;
+  char    *ap, *bp, *aend, *bend;
+  int64_t  ncells = 0;
+  int64_t  ndiff  = 0;
+  int      nline  = 0;
+  int      ndump  = 0;
+  int      arow, brow, aoff, boff;
+  char     ast, bst;
+  int      nval, j;
+  long     a, b;
+  int      astatus, bstatus;
+  int      status;
+
+  while (1)
+    {
+      astatus = esl_fgets(&abuf, &an, afp);
+      bstatus = esl_fgets(&bbuf, &bn, bfp);
+      if (astatus == eslEMEM || bstatus == eslEMEM) { status = eslEMEM; goto ERROR; }
+      if (astatus == eslEOF  && bstatus == eslEOF)  break;
+      nline++;
+      if (astatus != bstatus) {
+	if (ofp) fprintf(ofp, "# dumps differ in length: one ends at line %d\n", nline);
+	status = eslEFORMAT; goto ERROR;
+      }
+
+      /* Headers, separators and blank lines only need to agree on
+       * their width; that's how we catch two different M's.
+       */
+      if (sscanf(abuf, "%d %c%n", &arow, &ast, &aoff) != 2 || (ast != 'M' && ast != 'I' && ast != 'D'))
+	{
+	  if (dumpline_nvalues(abuf) != dumpline_nvalues(bbuf)) {
+	    if (ofp) fprintf(ofp, "# dumps differ in shape at line %d\n", nline);
+	    status = eslEFORMAT; goto ERROR;
+	  }
+	  continue;
+	}
+      if (sscanf(bbuf, "%d %c%n", &brow, &bst, &boff) != 2 || brow != arow || bst != ast ||
+	  (nval = dumpline_nvalues(abuf + aoff)) != dumpline_nvalues(bbuf + boff))
+	{
+	  if (ofp) fprintf(ofp, "# dumps differ in shape at line %d\n", nline);
+	  status = eslEFORMAT; goto ERROR;
+	}
+      if (arow == 0 && ast == 'M') ndump++;
+
+      /* M rows end with the five specials */
+      ap = abuf + aoff;
+      bp = bbuf + boff;
+      for (j = 0; j < nval; j++)
+	{
+	  a = strtol(ap, &aend, 10);
+	  b = strtol(bp, &bend, 10);
+	  if (aend == ap || bend == bp) {
+	    if (ofp) fprintf(ofp, "# bad value at line %d\n", nline);
+	    status = eslEFORMAT; goto ERROR;
+	  }
+	  ncells++;
+	  if (labs(a - b) > tol)
+	    {
+	      ndiff++;
+	      if (ofp && ndiff <= maxshow) {
+		if (ast == 'M' && j >= nval-5) fprintf(ofp, "dump %d row %d %c %s: %ld %ld\n",    ndump, arow, ast, xname[j-(nval-5)], a, b);
+		else                           fprintf(ofp, "dump %d row %d %c k=%d: %ld %ld\n",  ndump, arow, ast, j, a, b);
+	      }
+	    }
+	  ap = aend;
+	  bp = bend;
+	}
+    }
+  if (ofp && ndiff > maxshow) fprintf(ofp, "# ... and %" PRId64 " more mismatching cells\n", ndiff - maxshow);
+  status = (ndiff ? eslFAIL : eslOK);
+  /* fallthrough */
+ ERROR:
+  if (opt_ncells) *opt_ncells = ncells;
+  if (opt_ndiff)  *opt_ndiff  = ndiff;
+  free(abuf);
+  free(bbuf);
+  return status;
+}
+/*------------- end, debugging and development ------------------*/
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7FILTERMX_TESTDRIVE
+
+/* write_testdump()
+ * Write a little MSV-style dump, M=3, two rows, with one cell changed
+ * by <delta>, and the last row left out if <truncate> is TRUE.
+ */
+static void
+write_testdump(FILE *fp, int delta, int truncate)
+{
+  fprintf(fp, "         0   1   2   3   E   N   J   B   C\n");
+  fprintf(fp, "       --- --- --- --- --- --- --- --- ---\n");
+  fprintf(fp, "   0 M   0   0   0   0   0 190   0 188   0 \n");
+  fprintf(fp, "   0 I   0   0   0   0 \n");
+  fprintf(fp, "   0 D   0   0   0   0 \n\n");
+  if (truncate) return;
+  fprintf(fp, "   1 M   0 201 %3d 195 203 190   0 188   0 \n", 197 + delta);
+  fprintf(fp, "   1 I   0   0   0   0 \n");
+  fprintf(fp, "   1 D   0   0   0   0 \n\n");
+}
+
+static FILE *
+testdump(int delta, int truncate)
+{
+  FILE *fp;
+
+  if ((fp = tmpfile()) == NULL) esl_fatal("p7_filtermx.c :: tmpfile() failed");
+  write_testdump(fp, delta, truncate);
+  rewind(fp);
+  return fp;
+}
+
+static void
+utest_comparedumps(void)
+{
+  char     msg[] = "p7_filtermx.c :: dump comparison unit test failed";
+  FILE    *afp, *bfp;
+  int64_t  ncells, ndiff;
+
+  /* identical dumps: 2 rows x (9 + 4 + 4) cells */
+  afp = testdump(0, FALSE);
+  bfp = testdump(0, FALSE);
+  if (p7_filtermx_CompareDumps(afp, bfp, 0, NULL, 0, &ncells, &ndiff) != eslOK) esl_fatal(msg);
+  if (ncells != 34 || ndiff != 0) esl_fatal(msg);
+  fclose(afp); fclose(bfp);
+
+  /* one cell off by 1: caught at tol 0, accepted at tol 1 */
+  afp = testdump(0, FALSE);
+  bfp = testdump(1, FALSE);
+  if (p7_filtermx_CompareDumps(afp, bfp, 0, NULL, 0, &ncells, &ndiff) != eslFAIL) esl_fatal(msg);
+  if (ncells != 34 || ndiff != 1) esl_fatal(msg);
+  rewind(afp); rewind(bfp);
+  if (p7_filtermx_CompareDumps(afp, bfp, 1, NULL, 0, &ncells, &ndiff) != eslOK) esl_fatal(msg);
+  fclose(afp); fclose(bfp);
+
+  /* a missing row is a shape mismatch, not a cell mismatch */
+  afp = testdump(0, FALSE);
+  bfp = testdump(0, TRUE);
+  if (p7_filtermx_CompareDumps(afp, bfp, 0, NULL, 0, &ncells, &ndiff) != eslEFORMAT) esl_fatal(msg);
+  if (ncells != 17 || ndiff != 0) esl_fatal(msg);
+  fclose(afp); fclose(bfp);
+}
+#endif /*p7FILTERMX_TESTDRIVE*/
+/*------------------- end, unit tests ---------------------------*/
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7FILTERMX_TESTDRIVE
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for p7_filtermx.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  utest_comparedumps();
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_getopts_Destroy(go);
+  exit(0);
+}
+#endif /*p7FILTERMX_TESTDRIVE*/
+/*-------------------- end of test driver ---------------------*/
+
+
 
 /*****************************************************************
  * @LICENSE@
@@ -40,6 +40,7 @@ extern int          p7_filtermx_Reuse  (P7_FILTERMX *fx);
 extern void         p7_filtermx_Destroy(P7_FILTERMX *fx);
 
 extern int p7_filtermx_SetDumpMode(P7_FILTERMX *fx, FILE *dfp, int truefalse);
+extern int p7_filtermx_CompareDumps(FILE *afp, FILE *bfp, int tol, FILE *ofp, int maxshow, int64_t *opt_ncells, int64_t *opt_ndiff);
 #ifdef p7_DEBUGGING
 extern int p7_filtermx_DumpMFRow(const P7_FILTERMX *fx, int rowi, uint8_t xE, uint8_t xN, uint8_t xJ, uint8_t xB, uint8_t xC);
 extern int p7_filtermx_DumpVFRow(const P7_FILTERMX *fx, int rowi, int16_t xE, int16_t xN, int16_t xJ, int16_t xB, int16_t xC);
@@ -0,0 +1,271 @@
+/* P7_MEMGOV: a process-wide memory budget for DP matrices,
+ * shared by all the engines of a thread crew.
+ *
+ * Contents:
+ *   1. P7_MEMGOV object
+ *   2. Unit tests
+ *   3. Test driver
+ *   4. Copyright and license information
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+
+#include "p7_memgov.h"
+
+/*****************************************************************
+ * 1. The P7_MEMGOV object
+ *****************************************************************/
+
+/* Function:  p7_memgov_Create()
+ * Synopsis:  Create a new memory governor.
+ *
+ * Purpose:   Create a governor that allows at most <budget> bytes
+ *            to be reserved at any one time. Engines that are
+ *            holding more than <keep> bytes at the end of a
+ *            comparison are expected to shrink back and return the
+ *            difference. <keep> should be about <budget> divided by
+ *            the number of engines sharing the governor, so one
+ *            long target can't starve the rest of the crew
+ *            indefinitely.
+ *
+ * Returns:   ptr to the new <P7_MEMGOV>.
+ *
+ * Throws:    <NULL> on allocation failure, or if the mutex can't
+ *            be initialized.
+ */
+P7_MEMGOV *
+p7_memgov_Create(int64_t budget, int64_t keep)
+{
+  P7_MEMGOV *mg = NULL;
+  int        status;
+
+  ESL_DASSERT1(( budget > 0 ));
+  ESL_DASSERT1(( keep   > 0 && keep <= budget ));
+
+  ESL_ALLOC(mg, sizeof(P7_MEMGOV));
+  mg->budget    = budget;
+  mg->keep      = keep;
+  mg->reserved  = 0;
+  mg->peak      = 0;
+  mg->n_granted = 0;
+  mg->n_refused = 0;
+  mg->n_charged = 0;
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&mg->mutex, NULL) != 0) { free(mg); return NULL; }
+#endif
+  return mg;
+
+ ERROR:
+  return NULL;
+}
+
+
+/* Function:  p7_memgov_Reserve()
+ * Synopsis:  Try to reserve <nbytes> from the budget.
+ *
+ * Purpose:   If <nbytes> more can be reserved without exceeding the
+ *            budget, reserve them and return <eslOK>. Otherwise
+ *            leave the governor unchanged and return <eslFAIL>.
+ *            Never blocks (other than on the mutex).
+ *
+ * Returns:   <eslOK> if the reservation was granted.
+ *            <eslFAIL> if it was refused.
+ */
+int
+p7_memgov_Reserve(P7_MEMGOV *mg, int64_t nbytes)
+{
+  int status;
+
+  ESL_DASSERT1(( nbytes >= 0 ));
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&mg->mutex);
+#endif
+  if (mg->reserved + nbytes <= mg->budget)
+    {
+      mg->reserved += nbytes;
+      mg->peak      = ESL_MAX(mg->peak, mg->reserved);
+      mg->n_granted++;
+      status = eslOK;
+    }
+  else
+    {
+      mg->n_refused++;
+      status = eslFAIL;
+    }
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&mg->mutex);
+#endif
+  return status;
+}
+
+
+/* Function:  p7_memgov_Charge()
+ * Synopsis:  Unconditionally add <nbytes> to the reserved total.
+ *
+ * Purpose:   Record <nbytes> that an engine is already holding, even
+ *            if that takes the total over budget. Engines use this
+ *            to true up their accounts when an allocation turned out
+ *            bigger than the estimate they reserved; it is not a way
+ *            around <p7_memgov_Reserve()>.
+ */
+void
+p7_memgov_Charge(P7_MEMGOV *mg, int64_t nbytes)
+{
+  ESL_DASSERT1(( nbytes >= 0 ));
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&mg->mutex);
+#endif
+  mg->reserved += nbytes;
+  mg->peak      = ESL_MAX(mg->peak, mg->reserved);
+  if (mg->reserved > mg->budget) mg->n_charged++;
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&mg->mutex);
+#endif
+}
+
+
+/* Function:  p7_memgov_Release()
+ * Synopsis:  Return <nbytes> to the budget.
+ */
+void
+p7_memgov_Release(P7_MEMGOV *mg, int64_t nbytes)
+{
+  ESL_DASSERT1(( nbytes >= 0 ));
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&mg->mutex);
+#endif
+  mg->reserved -= nbytes;
+  ESL_DASSERT1(( mg->reserved >= 0 ));
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&mg->mutex);
+#endif
+}
+
+
+/* Function:  p7_memgov_Dump()
+ * Synopsis:  Dump budget, current and peak usage, and counters.
+ */
+int
+p7_memgov_Dump(FILE *ofp, P7_MEMGOV *mg)
+{
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&mg->mutex);
+#endif
+  fprintf(ofp, "# memory budget:      %.1f MB (keep %.1f MB per engine)\n", (double) mg->budget / 1048576., (double) mg->keep / 1048576.);
+  fprintf(ofp, "# reserved now/peak:  %.1f / %.1f MB\n", (double) mg->reserved / 1048576., (double) mg->peak / 1048576.);
+  fprintf(ofp, "# reservations:       %" PRId64 " granted, %" PRId64 " refused\n", mg->n_granted, mg->n_refused);
+  fprintf(ofp, "# over-budget charges: %" PRId64 "\n", mg->n_charged);
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&mg->mutex);
+#endif
+  return eslOK;
+}
+
+
+/* Function:  p7_memgov_Destroy()
+ * Synopsis:  Free a <P7_MEMGOV>.
+ */
+void
+p7_memgov_Destroy(P7_MEMGOV *mg)
+{
+  if (mg)
+    {
+#ifdef HMMER_THREADS
+      pthread_mutex_destroy(&mg->mutex);
+#endif
+      free(mg);
+    }
+}
+/*----------------- end, P7_MEMGOV object -----------------------*/
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7MEMGOV_TESTDRIVE
+
+static void
+utest_budget(void)
+{
+  char       msg[] = "p7_memgov.c :: budget unit test failed";
+  P7_MEMGOV *mg    = p7_memgov_Create(1000, 500);
+
+  if (p7_memgov_Reserve(mg, 600) != eslOK)   esl_fatal(msg);
+  if (p7_memgov_Reserve(mg, 400) != eslOK)   esl_fatal(msg);  // exactly at budget is ok
+  if (p7_memgov_Reserve(mg, 1)   != eslFAIL) esl_fatal(msg);
+  if (mg->reserved != 1000)                  esl_fatal(msg);
+
+  p7_memgov_Release(mg, 600);
+  if (p7_memgov_Reserve(mg, 500) != eslOK)   esl_fatal(msg);
+  p7_memgov_Charge (mg, 200);                                 // over budget: allowed, but counted
+  if (mg->reserved  != 1100)                 esl_fatal(msg);
+  if (mg->peak      != 1100)                 esl_fatal(msg);
+  if (mg->n_charged != 1)                    esl_fatal(msg);
+  if (p7_memgov_Reserve(mg, 0)   != eslFAIL) esl_fatal(msg);
+
+  p7_memgov_Release(mg, 1100);
+  if (mg->reserved  != 0)                    esl_fatal(msg);
+  if (mg->n_granted != 3)                    esl_fatal(msg);
+  if (mg->n_refused != 2)                    esl_fatal(msg);
+
+  p7_memgov_Destroy(mg);
+}
+#endif /*p7MEMGOV_TESTDRIVE*/
+/*------------------- end, unit tests ---------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7MEMGOV_TESTDRIVE
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for p7_memgov.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  utest_budget();
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_getopts_Destroy(go);
+  exit(0);
+}
+#endif /*p7MEMGOV_TESTDRIVE*/
+/*-------------------- end of test driver ---------------------*/
+
+
+/*****************************************************************
+ * @LICENSE@
+ *
+ * SVN $Id$
+ * SVN $URL$
+ *****************************************************************/
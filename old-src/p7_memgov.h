@@ -0,0 +1,56 @@
+/* P7_MEMGOV: a process-wide memory budget for DP matrices.
+ *
+ * Each worker thread has its own P7_ENGINE, and each engine grows
+ * its checkpointed and sparse DP matrices to fit the largest
+ * comparison it has seen. With many threads, a handful of long
+ * targets can push total RSS far past what the machine has. A
+ * P7_MEMGOV is shared by all the engines of a crew: an engine has
+ * to Reserve() bytes from it before it grows a matrix, and
+ * Release()'s them when it shrinks back.
+ *
+ * The governor only does bookkeeping; it doesn't allocate anything
+ * itself. What an engine does when a reservation is refused (fall
+ * back to more checkpointing, or give the comparison up so the
+ * caller can run it somewhere else) is the engine's business; see
+ * p7_engine.c.
+ */
+#ifndef p7MEMGOV_INCLUDED
+#define p7MEMGOV_INCLUDED
+
+#include "p7_config.h"
+
+#include <stdio.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+typedef struct p7_memgov_s {
+  int64_t  budget;      // total bytes that all engines together may reserve
+  int64_t  keep;        // an engine holding more than this between comparisons shrinks back
+  int64_t  reserved;    // bytes currently reserved
+  int64_t  peak;        // high-water mark of <reserved>
+
+  int64_t  n_granted;   // # of Reserve() calls that succeeded
+  int64_t  n_refused;   // # of Reserve() calls that were refused
+  int64_t  n_charged;   // # of Charge() calls that pushed <reserved> past <budget>
+
+#ifdef HMMER_THREADS
+  pthread_mutex_t mutex;
+#endif
+} P7_MEMGOV;
+
+extern P7_MEMGOV *p7_memgov_Create (int64_t budget, int64_t keep);
+extern int        p7_memgov_Reserve(P7_MEMGOV *mg, int64_t nbytes);
+extern void       p7_memgov_Charge (P7_MEMGOV *mg, int64_t nbytes);
+extern void       p7_memgov_Release(P7_MEMGOV *mg, int64_t nbytes);
+extern int        p7_memgov_Dump   (FILE *ofp, P7_MEMGOV *mg);
+extern void       p7_memgov_Destroy(P7_MEMGOV *mg);
+
+#endif /*p7MEMGOV_INCLUDED*/
+/*****************************************************************
+ * @LICENSE@
+ * 
+ * SVN $Id$
+ * SVN $URL$
+ *****************************************************************/
@@ -347,12 +347,123 @@ p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data )
 }
 
 
+
+/* window_sorter()
+ * qsort() comparison function for p7_hmm_ExtendAndMergeWindows():
+ * sort windows by sequence id, then by start position.
+ */
+static int
+window_sorter(const void *vw1, const void *vw2)
+{
+  const P7_HMM_WINDOW *w1 = (const P7_HMM_WINDOW *) vw1;
+  const P7_HMM_WINDOW *w2 = (const P7_HMM_WINDOW *) vw2;
+
+  if      (w1->id < w2->id) return -1;
+  else if (w1->id > w2->id) return  1;
+  else if (w1->n  < w2->n)  return -1;
+  else if (w1->n  > w2->n)  return  1;
+  else                      return  0;
+}
+
+
+/* Function:  p7_hmm_ExtendAndMergeWindows()
+ * Synopsis:  Turn SSV diagonals into windows for the later filters.
+ *
+ * Purpose:   Given a list <windowlist> of SSV diagonals found on target
+ *            sequence(s) of length <L>, extend each diagonal into a
+ *            window that could hold a complete alignment to model <om>,
+ *            then merge windows that overlap. Upon return, <windowlist>
+ *            contains the merged windows, sorted by sequence <id> and
+ *            start position <n>, and the Viterbi/Forward filters and
+ *            the main engine can be run on each window's subsequence
+ *            <dsq + n - 1>, of length <length>, instead of on the
+ *            whole target.
+ *
+ *            A diagonal covering model positions <ka..kb> is extended
+ *            upstream by the expected length of the prefix <1..ka-1>,
+ *            and downstream by the expected length of the suffix
+ *            <kb+1..M>, using the <prefix_lengths> and <suffix_lengths>
+ *            in <data>, which are fractions of <om->max_length>. Each
+ *            side gets an extra 0.1 of <om->max_length> as a buffer.
+ *            Windows are clipped to <1..L>.
+ *
+ *            Two windows on the same sequence are merged if the
+ *            fraction of the shorter one covered by their overlap is
+ *            greater than <pct_overlap>. A <pct_overlap> of 0.0 merges
+ *            any windows that overlap at all.
+ *
+ *            <data> must have its <prefix_lengths> and <suffix_lengths>
+ *            computed by <p7_hmm_ScoreDataComputeRest()>, and
+ *            <om->max_length> must be set.
+ *
+ * Args:      om          - optimized profile the diagonals came from
+ *            data        - score data for <om>, with prefix/suffix lengths
+ *            windowlist  - SSV diagonals; RETURN: extended and merged windows
+ *            L           - length of the target sequence(s)
+ *            pct_overlap - merge windows if overlap/shorter length exceeds this
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_hmm_ExtendAndMergeWindows(const P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_WINDOWLIST *windowlist, int L, float pct_overlap)
+{
+  P7_HMM_WINDOW *prev_window;
+  P7_HMM_WINDOW *curr_window;
+  int            window_start;
+  int            window_end;
+  int            new_hit_cnt = 0;
+  int            i;
+
+  if (windowlist->count == 0) return eslOK;
+
+  /* extend each diagonal by its expected prefix and suffix lengths */
+  for (i = 0; i < windowlist->count; i++)
+    {
+      curr_window  = windowlist->windows + i;
+      window_start = ESL_MAX( 1, curr_window->n - (int) (om->max_length * (0.1 + data->prefix_lengths[curr_window->k - curr_window->length + 1])));
+      window_end   = ESL_MIN( L, curr_window->n + curr_window->length - 1 + (int) (om->max_length * (0.1 + data->suffix_lengths[curr_window->k])));
+      curr_window->n      = window_start;
+      curr_window->length = window_end - window_start + 1;
+    }
+
+  qsort(windowlist->windows, windowlist->count, sizeof(P7_HMM_WINDOW), window_sorter);
+
+  /* merge overlapping windows, compressing the list in place */
+  for (i = 1; i < windowlist->count; i++)
+    {
+      prev_window  = windowlist->windows + new_hit_cnt;
+      curr_window  = windowlist->windows + i;
+      window_start = ESL_MAX(prev_window->n, curr_window->n);
+      window_end   = ESL_MIN(prev_window->n + prev_window->length - 1, curr_window->n + curr_window->length - 1);
+
+      if (curr_window->id == prev_window->id &&
+          window_end >= window_start &&
+          (float) (window_end - window_start + 1) / (float) ESL_MIN(prev_window->length, curr_window->length) > pct_overlap)
+        {
+          if (curr_window->n + curr_window->length > prev_window->n + prev_window->length)
+            prev_window->length = curr_window->n + curr_window->length - prev_window->n;
+          prev_window->score = ESL_MAX(prev_window->score, curr_window->score);
+        }
+      else
+        {
+          new_hit_cnt++;
+          windowlist->windows[new_hit_cnt] = windowlist->windows[i];
+        }
+    }
+  windowlist->count = new_hit_cnt + 1;
+  return eslOK;
+}
+
+
 /*****************************************************************
  * 2. Unit tests
  *****************************************************************/
 #ifdef p7SCOREDATA_TESTDRIVE
 
+#include "base/p7_bg.h"
+#include "base/p7_profile.h"
 #include "build/modelsample.h"
+#include "search/modelconfig.h"
 
 static void
 utest_createScoreData(ESL_GETOPTS *go, ESL_RANDOMNESS *r )
@@ -386,6 +497,73 @@ utest_createScoreData(ESL_GETOPTS *go, ESL_RANDOMNESS *r )
   esl_alphabet_Destroy(abc);
 
 }
+
+/* utest_extendAndMergeWindows()
+ * Extend and merge a random set of SSV-like diagonals on a target of
+ * length L; the resulting windows must lie in 1..L, be sorted and
+ * disjoint, and every original diagonal must lie inside one of them.
+ */
+static void
+utest_extendAndMergeWindows(ESL_GETOPTS *go, ESL_RANDOMNESS *r)
+{
+  char               msg[]     = "extend and merge windows unit test failed";
+  P7_HMM            *hmm       = NULL;
+  ESL_ALPHABET      *abc       = NULL;
+  P7_BG             *bg        = NULL;
+  P7_PROFILE        *gm        = NULL;
+  P7_OPROFILE       *om        = NULL;
+  P7_SCOREDATA      *scoredata = NULL;
+  P7_HMM_WINDOWLIST  wl;
+  int                M         = 50;
+  int                L         = 100000;
+  int                ndiag     = 20;
+  int                dstart[20];
+  int                dlen[20];
+  int                i, w;
+
+  if ( (abc = esl_alphabet_Create(eslDNA)) == NULL)    esl_fatal(msg);
+  if ( (bg  = p7_bg_Create(abc))           == NULL)    esl_fatal(msg);
+  if (  p7_modelsample(r, M, abc, &hmm)    != eslOK)   esl_fatal(msg);
+  if ( (gm = p7_profile_Create (hmm->M, abc)) == NULL) esl_fatal(msg);
+  if ( (om = p7_oprofile_Create(hmm->M, abc)) == NULL) esl_fatal(msg);
+  if (  p7_profile_Config(gm, hmm, bg)     != eslOK)   esl_fatal(msg);
+  if (  p7_oprofile_Convert(gm, om)        != eslOK)   esl_fatal(msg);
+  om->max_length = 2 * M;
+
+  if ( (scoredata = p7_hmm_ScoreDataCreate(om, FALSE)) == NULL)   esl_fatal(msg);
+  if (  p7_hmm_ScoreDataComputeRest(om, scoredata)     != eslOK)  esl_fatal(msg);
+  if (  p7_hmmwindow_init(&wl)                         != eslOK)  esl_fatal(msg);
+
+  for (i = 0; i < ndiag; i++)
+    {
+      dlen[i]   = 1 + esl_rnd_Roll(r, 10);                         // 1..10
+      dstart[i] = 1 + esl_rnd_Roll(r, L - dlen[i] + 1);            // 1..L-dlen+1
+      if (p7_hmmwindow_new(&wl, 0, dstart[i], 0, dlen[i] + esl_rnd_Roll(r, M - dlen[i] + 1), dlen[i], 0.0, 0) == NULL) esl_fatal(msg);
+    }
+
+  if (p7_hmm_ExtendAndMergeWindows(om, scoredata, &wl, L, 0.0) != eslOK) esl_fatal(msg);
+
+  if (wl.count < 1 || wl.count > ndiag) esl_fatal(msg);
+  for (w = 0; w < wl.count; w++)
+    {
+      if (wl.windows[w].n < 1 || wl.windows[w].n + wl.windows[w].length - 1 > L)            esl_fatal(msg);
+      if (w > 0 && wl.windows[w].n <= wl.windows[w-1].n + wl.windows[w-1].length - 1)       esl_fatal(msg);
+    }
+  for (i = 0; i < ndiag; i++)
+    {
+      for (w = 0; w < wl.count; w++)
+        if (dstart[i] >= wl.windows[w].n && dstart[i] + dlen[i] - 1 <= wl.windows[w].n + wl.windows[w].length - 1) break;
+      if (w == wl.count) esl_fatal(msg);
+    }
+
+  free(wl.windows);
+  p7_hmm_ScoreDataDestroy(scoredata);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*p7BG_TESTDRIVE*/
 
 
@@ -424,6 +602,7 @@ main(int argc, char **argv)
   fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_createScoreData(go, rng);
+  utest_extendAndMergeWindows(go, rng);
 
   fprintf(stderr, "#  status = ok\n");
 
@@ -27,6 +27,7 @@ extern P7_SCOREDATA   *p7_hmm_ScoreDataCreate(P7_OPROFILE *om, int do_opt_ext);
 extern P7_SCOREDATA   *p7_hmm_ScoreDataClone(P7_SCOREDATA *src, int K);
 extern int            p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data );
 extern void           p7_hmm_ScoreDataDestroy( P7_SCOREDATA *data );
+extern int            p7_hmm_ExtendAndMergeWindows(const P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_WINDOWLIST *windowlist, int L, float pct_overlap);
 extern int            p7_hmm_initWindows (P7_HMM_WINDOWLIST *list);
 extern P7_HMM_WINDOW *p7_hmm_newWindow (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t fm_pos, uint16_t k, uint32_t length, float score, uint8_t complementarity);
 
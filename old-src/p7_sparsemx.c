@@ -21,7 +21,9 @@
  *   5. API for extracting information from a sparse DP matrix
  *   6. Debugging tools for P7_SPARSEMX
  *   7. Validation of a P7_SPARSEMX
- *   8. Copyright and license information  
+ *   8. Unit tests
+ *   9. Test driver
+ *  10. Copyright and license information  
  */
 
 #include "p7_config.h"
@@ -515,6 +517,54 @@ p7_sparsemask_Finish(P7_SPARSEMASK *sm)
  ERROR:
   return eslEMEM;
 }
+
+/* Function:  p7_sparsemask_SegmentOffsets()
+ * Synopsis:  Find where each segment starts in a sparse DP matrix.
+ *
+ * Purpose:   For a finished sparse mask <sm>, calculate where each
+ *            segment <s=1..S> starts in the <dp> and <xmx> arrays of
+ *            a <P7_SPARSEMX> built on <sm>. <dpoff[s]> is the offset
+ *            of row <seg[s].ia>'s first supercell in <dp>, counted in
+ *            supercells; <xoff[s]> is the offset of the special
+ *            supercell for row <seg[s].ia-1> in <xmx>, counted in
+ *            special supercells. <dpoff[S+1]> and <xoff[S+1]> are set
+ *            to the totals, <ncells> and <nrow+S>, so segment <s>
+ *            occupies <dpoff[s]..dpoff[s+1]-1> and <xoff[s]..xoff[s+1]-1>.
+ *            <dpoff[0]> and <xoff[0]> are unused, and set to 0.
+ *
+ *            Segments only pass N/J/C specials to each other, so with
+ *            these offsets a segment-parallel sparse DP can fill
+ *            each segment without sweeping over the ones before it.
+ *            <p7_sparsemask_Validate()> checks that the totals agree
+ *            with <ncells> and <nrow>.
+ *
+ * Args:      sm    - finished sparse mask
+ *            dpoff - RETURN: [0..S+1] supercell offsets in <dp>; caller allocates for S+2
+ *            xoff  - RETURN: [0..S+1] special row offsets in <xmx>; caller allocates for S+2
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_sparsemask_SegmentOffsets(const P7_SPARSEMASK *sm, int64_t *dpoff, int *xoff)
+{
+  int64_t ndp = 0;
+  int     nx  = 0;
+  int     s, i;
+
+  dpoff[0] = 0;
+  xoff[0]  = 0;
+  for (s = 1; s <= sm->S; s++)
+    {
+      dpoff[s] = ndp;
+      xoff[s]  = nx;
+      for (i = sm->seg[s].ia; i <= sm->seg[s].ib; i++)
+	ndp += sm->n[i];
+      nx += sm->seg[s].ib - sm->seg[s].ia + 2;   // +2: the ia-1 row, plus ia..ib inclusive
+    }
+  dpoff[s] = ndp;
+  xoff[s]  = nx;
+  return eslOK;
+}
 /*----------------- end, P7_SPARSEMASK API ----------------------*/
 
 
@@ -603,6 +653,8 @@ p7_sparsemask_Compare(const P7_SPARSEMASK *sm1, const P7_SPARSEMASK *sm2)
  *            <eslFAIL> on failure; <errbuf>, if provided, contains an
  *            informative error message.
  *            
+ * Throws:    <eslEMEM> on allocation failure.
+ *
  * Note:      We don't check for all possible invalidity; the goal of a
  *            Validate() is primarily to catch any future problems
  *            similar to past problems that we've already run across
@@ -611,7 +663,10 @@ p7_sparsemask_Compare(const P7_SPARSEMASK *sm1, const P7_SPARSEMASK *sm2)
 int
 p7_sparsemask_Validate(const P7_SPARSEMASK *sm, char *errbuf)
 {
-  int g, i;
+  int64_t *dpoff = NULL;
+  int     *xoff  = NULL;
+  int      g, i;
+  int      status;
 
   if (errbuf) errbuf[0] = '\0';
 
@@ -634,7 +689,21 @@ p7_sparsemask_Validate(const P7_SPARSEMASK *sm, char *errbuf)
   for (i = sm->seg[sm->S].ib+1; i <= sm->L; i++)
     if (sm->n[i] != 0) ESL_FAIL(eslFAIL, errbuf, "n[i] != 0 for i unmarked, not in sparse segment");
 
+  /* Segment offsets must add up to the sizes a P7_SPARSEMX gets allocated for. */
+  ESL_ALLOC(dpoff, sizeof(int64_t) * (sm->S+2));
+  ESL_ALLOC(xoff,  sizeof(int)     * (sm->S+2));
+  p7_sparsemask_SegmentOffsets(sm, dpoff, xoff);
+  if (dpoff[sm->S+1] != sm->ncells)        ESL_XFAIL(eslFAIL, errbuf, "n[i] don't sum to ncells");
+  if (xoff[sm->S+1]  != sm->nrow + sm->S)  ESL_XFAIL(eslFAIL, errbuf, "segment lengths don't sum to nrow");
+
+  free(dpoff);
+  free(xoff);
   return eslOK;
+
+ ERROR:
+  if (dpoff) free(dpoff);
+  if (xoff)  free(xoff);
+  return status;
 }
 
 /* Function:  p7_sparsemask_SetFromTrace()
@@ -1976,6 +2045,156 @@ p7_sparsemx_Validate(const P7_SPARSEMX *sx, char *errbuf)
 
 
 
+/*****************************************************************
+ * 8. Unit tests
+ *****************************************************************/
+#ifdef p7SPARSEMX_TESTDRIVE
+
+#include "esl_alphabet.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+
+/* utest_segment_offsets()
+ * Sample sparse masks around emitted traces, with random scatter, and
+ * check p7_sparsemask_SegmentOffsets() against a serial walk of the
+ * matrix layout: <dp> holds n[i] supercells for each row i=1..L, and
+ * <xmx> holds a special row for each row i=0..L with n[i] or n[i+1]
+ * nonzero, the latter being a segment's ia-1 row. Also check the
+ * all-cells mask, which is one segment.
+ */
+static void
+utest_segment_offsets(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char           msg[] = "p7_sparsemx.c :: segment offsets unit test failed";
+  P7_HMM        *hmm   = NULL;
+  P7_PROFILE    *gm    = p7_profile_Create(M, abc);
+  ESL_SQ        *sq    = esl_sq_CreateDigital(abc);
+  P7_TRACE      *tr    = p7_trace_Create();
+  P7_SPARSEMASK *sm    = NULL;
+  int64_t       *dpoff = NULL;
+  int           *xoff  = NULL;
+  int64_t        ndp;
+  int            nx, s, i, idx;
+  char           errbuf[eslERRBUFSIZE];
+
+  if ( p7_modelsample(rng, M, abc, &hmm) != eslOK) esl_fatal(msg);
+  if ( p7_profile_Config(gm, hmm, bg)    != eslOK) esl_fatal(msg);
+  if ( p7_profile_SetLength(gm, L)       != eslOK) esl_fatal(msg);
+
+  for (idx = 0; idx < N; idx++)
+    {
+      if ( p7_ProfileEmit(rng, hmm, gm, bg, sq, tr)  != eslOK) esl_fatal(msg);
+      if ( (sm = p7_sparsemask_Create(M, sq->n))     == NULL)  esl_fatal(msg);
+      if ( p7_sparsemask_SetFromTrace(sm, rng, tr)   != eslOK) esl_fatal(msg);
+      if ( p7_sparsemask_Validate(sm, errbuf)        != eslOK) esl_fatal("%s\n  %s", msg, errbuf);
+
+      if (( dpoff = malloc(sizeof(int64_t) * (sm->S+2))) == NULL) esl_fatal(msg);
+      if (( xoff  = malloc(sizeof(int)     * (sm->S+2))) == NULL) esl_fatal(msg);
+      if ( p7_sparsemask_SegmentOffsets(sm, dpoff, xoff) != eslOK) esl_fatal(msg);
+
+      ndp = 0;
+      nx  = 0;
+      s   = 0;
+      for (i = 0; i <= sm->L; i++)
+	{
+	  if (i < sm->L && sm->n[i+1] && ! sm->n[i])      // row i is ia-1 of the next segment
+	    {
+	      s++;
+	      if (s > sm->S)               esl_fatal(msg);
+	      if (sm->seg[s].ia != i+1)    esl_fatal(msg);
+	      if (dpoff[s]      != ndp)    esl_fatal(msg);
+	      if (xoff[s]       != nx)     esl_fatal(msg);
+	    }
+	  if (sm->n[i] || (i < sm->L && sm->n[i+1])) nx++;
+	  ndp += sm->n[i];
+	}
+      if (s                != sm->S)             esl_fatal(msg);
+      if (dpoff[sm->S+1]   != ndp)               esl_fatal(msg);
+      if (xoff[sm->S+1]    != nx)                esl_fatal(msg);
+      if (ndp              != sm->ncells)        esl_fatal(msg);
+      if (nx               != sm->nrow + sm->S)  esl_fatal(msg);
+
+      free(dpoff);
+      free(xoff);
+      p7_sparsemask_Destroy(sm);
+      esl_sq_Reuse(sq);
+      p7_trace_Reuse(tr);
+    }
+
+  /* All cells: one segment, starting at the top of both arrays. */
+  if ( (sm = p7_sparsemask_Create(M, L))               == NULL)  esl_fatal(msg);
+  if ( p7_sparsemask_AddAll(sm)                        != eslOK) esl_fatal(msg);
+  if (( dpoff = malloc(sizeof(int64_t) * (sm->S+2)))   == NULL)  esl_fatal(msg);
+  if (( xoff  = malloc(sizeof(int)     * (sm->S+2)))   == NULL)  esl_fatal(msg);
+  if ( p7_sparsemask_SegmentOffsets(sm, dpoff, xoff)   != eslOK) esl_fatal(msg);
+  if ( sm->S != 1 || dpoff[1] != 0 || xoff[1] != 0)              esl_fatal(msg);
+  if ( dpoff[2] != (int64_t) L * M || xoff[2] != L+1)            esl_fatal(msg);
+
+  free(dpoff);
+  free(xoff);
+  p7_sparsemask_Destroy(sm);
+  p7_trace_Destroy(tr);
+  esl_sq_Destroy(sq);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7SPARSEMX_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+/*****************************************************************
+ * 9. Test driver
+ *****************************************************************/
+#ifdef p7SPARSEMX_TESTDRIVE
+
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,      "0", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for p7_sparsemx.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng  = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg   = p7_bg_Create(abc);
+  int             M    = 50;
+  int             L    = 200;
+  int             N    = 20;
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_segment_offsets(rng, abc, bg, M, L, N);
+
+  fprintf(stderr, "#  status = ok\n");
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  exit(0);
+}
+#endif /*p7SPARSEMX_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+
 /*****************************************************************
  * @LICENSE@
  * 
@@ -141,6 +141,7 @@ extern int            p7_sparsemask_StartRow (P7_SPARSEMASK *sm, int i);
 extern int            p7_sparsemask_Add      (P7_SPARSEMASK *sm, int q, int r);
 extern int            p7_sparsemask_FinishRow(P7_SPARSEMASK *sm);
 extern int            p7_sparsemask_Finish   (P7_SPARSEMASK *sm);
+extern int            p7_sparsemask_SegmentOffsets(const P7_SPARSEMASK *sm, int64_t *dpoff, int *xoff);
 
 /* P7_SPARSEMASK debugging tools */
 extern int            p7_sparsemask_Dump(FILE *ofp, P7_SPARSEMASK *sm);
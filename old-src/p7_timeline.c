@@ -0,0 +1,348 @@
+/* P7_TIMELINE: per-thread event timelines, written as Chrome trace JSON.
+ *
+ * Contents:
+ *   1. P7_TIMELINE object
+ *   2. Unit tests
+ *   3. Test driver
+ *   4. Copyright and license information
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "easel.h"
+
+#include "p7_timeline.h"
+
+/*****************************************************************
+ * 1. The P7_TIMELINE object
+ *****************************************************************/
+
+/* timeline_clock()
+ * Current time in ns, on a clock that NTP doesn't slew.
+ */
+static int64_t
+timeline_clock(void)
+{
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (int64_t) ts.tv_sec * 1000000000ll + (int64_t) ts.tv_nsec;
+}
+
+
+/* Function:  p7_timeline_Create()
+ * Synopsis:  Create a new timeline.
+ *
+ * Purpose:   Create a timeline with <ntracks> tracks, typically one
+ *            per thread, each a ring of <nevents> spans; <nevents>
+ *            is rounded up to a power of 2. Pass 0 for
+ *            <nevents> to use the default, <p7_TIMELINE_NEVENTS>.
+ *            Times in the timeline are relative to its creation.
+ *
+ *            Tracks are named "thread <t>" until
+ *            <p7_timeline_SetTrackName()> says otherwise.
+ *
+ * Returns:   ptr to the new <P7_TIMELINE>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_TIMELINE *
+p7_timeline_Create(int ntracks, int nevents)
+{
+  P7_TIMELINE *tl = NULL;
+  int          t;
+  int          status;
+
+  ESL_DASSERT1(( ntracks > 0 ));
+  ESL_DASSERT1(( nevents >= 0 ));
+
+  ESL_ALLOC(tl, sizeof(P7_TIMELINE));
+  tl->track   = NULL;
+  tl->ntracks = ntracks;
+  for (tl->nevents = 1; tl->nevents < (nevents ? nevents : p7_TIMELINE_NEVENTS); tl->nevents <<= 1) ;
+
+  ESL_ALLOC(tl->track, sizeof(P7_TLTRACK *) * ntracks);
+  for (t = 0; t < ntracks; t++) tl->track[t] = NULL;
+  for (t = 0; t < ntracks; t++)
+    {
+      ESL_ALLOC(tl->track[t], sizeof(P7_TLTRACK));
+      tl->track[t]->span      = NULL;
+      tl->track[t]->nspan     = 0;
+      tl->track[t]->depth     = 0;
+      tl->track[t]->noverflow = 0;
+      snprintf(tl->track[t]->name, 32, "thread %d", t);
+      ESL_ALLOC(tl->track[t]->span, sizeof(P7_TLSPAN) * tl->nevents);
+    }
+  tl->epoch = timeline_clock();
+  return tl;
+
+ ERROR:
+  p7_timeline_Destroy(tl);
+  return NULL;
+}
+
+
+/* Function:  p7_timeline_SetTrackName()
+ * Synopsis:  Name track <t>.
+ *
+ * Purpose:   Set the name that track <t> is shown under. Names
+ *            longer than 31 characters are truncated.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_timeline_SetTrackName(P7_TIMELINE *tl, int t, const char *name)
+{
+  ESL_DASSERT1(( t >= 0 && t < tl->ntracks ));
+  snprintf(tl->track[t]->name, 32, "%s", name);
+  return eslOK;
+}
+
+
+/* Function:  p7_timeline_Begin()
+ * Synopsis:  Open a span called <name> on track <t>.
+ *
+ * Purpose:   Record the start of a span on track <t>. Only the thread
+ *            that owns track <t> may call this. Spans nest up to
+ *            <p7_TIMELINE_MAXDEPTH> deep; deeper ones are ignored,
+ *            but still have to be closed with <p7_timeline_End()>.
+ *
+ *            <tl> may be <NULL>, in which case this does nothing, so
+ *            callers don't need to test whether tracing is on.
+ */
+void
+p7_timeline_Begin(P7_TIMELINE *tl, int t, const char *name)
+{
+  P7_TLTRACK *tk;
+
+  if (! tl) return;
+  tk = tl->track[t];
+  if (tk->depth == p7_TIMELINE_MAXDEPTH) { tk->noverflow++; return; }
+  tk->open_name[tk->depth] = name;
+  tk->open_t0[tk->depth]   = timeline_clock();
+  tk->depth++;
+}
+
+
+/* Function:  p7_timeline_End()
+ * Synopsis:  Close the innermost open span on track <t>.
+ *
+ * Purpose:   Close the span most recently opened on track <t> and
+ *            store it in the track's ring, overwriting the oldest
+ *            span if the ring is full. Does nothing if <tl> is
+ *            <NULL>, or if no span is open.
+ */
+void
+p7_timeline_End(P7_TIMELINE *tl, int t)
+{
+  P7_TLTRACK *tk;
+  P7_TLSPAN  *sp;
+
+  if (! tl) return;
+  tk = tl->track[t];
+  if (tk->noverflow) { tk->noverflow--; return; }
+  if (tk->depth == 0) return;
+  tk->depth--;
+
+  sp       = &(tk->span[tk->nspan & (tl->nevents - 1)]);
+  sp->name = tk->open_name[tk->depth];
+  sp->t0   = tk->open_t0[tk->depth] - tl->epoch;
+  sp->dur  = timeline_clock() - tk->open_t0[tk->depth];
+  tk->nspan++;
+}
+
+
+/* Function:  p7_timeline_Dropped()
+ * Synopsis:  Return the number of spans lost to full rings.
+ */
+int64_t
+p7_timeline_Dropped(const P7_TIMELINE *tl)
+{
+  int64_t ndropped = 0;
+  int     t;
+
+  for (t = 0; t < tl->ntracks; t++)
+    if (tl->track[t]->nspan > tl->nevents)
+      ndropped += tl->track[t]->nspan - tl->nevents;
+  return ndropped;
+}
+
+
+/* Function:  p7_timeline_Write()
+ * Synopsis:  Write a timeline as Chrome trace JSON.
+ *
+ * Purpose:   Write the spans still in each track's ring to <ofp>,
+ *            oldest first, in the Chrome trace event format: a
+ *            thread name metadata event per track, then one
+ *            complete ("X") event per span, with times in
+ *            microseconds. The number of dropped spans is recorded
+ *            in "otherData". Spans still open aren't written.
+ *
+ *            Call this only when no thread is still recording.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on a write error.
+ */
+int
+p7_timeline_Write(FILE *ofp, const P7_TIMELINE *tl)
+{
+  P7_TLTRACK *tk;
+  P7_TLSPAN  *sp;
+  int64_t     i, first;
+  int         t;
+  int         n = 0;
+
+  if (fprintf(ofp, "{\"traceEvents\":[\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "timeline write failed");
+  for (t = 0; t < tl->ntracks; t++)
+    if (fprintf(ofp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		(n++ ? ",\n" : ""), t, tl->track[t]->name) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "timeline write failed");
+
+  for (t = 0; t < tl->ntracks; t++)
+    {
+      tk    = tl->track[t];
+      first = (tk->nspan > tl->nevents ? tk->nspan - tl->nevents : 0);
+      for (i = first; i < tk->nspan; i++)
+	{
+	  sp = &(tk->span[i & (tl->nevents - 1)]);
+	  if (fprintf(ofp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		      sp->name, t, (double) sp->t0 / 1000., (double) sp->dur / 1000.) < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "timeline write failed");
+	}
+    }
+
+  if (fprintf(ofp, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"dropped\":\"%" PRId64 "\"}}\n", p7_timeline_Dropped(tl)) < 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "timeline write failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_timeline_Destroy()
+ * Synopsis:  Free a <P7_TIMELINE>.
+ */
+void
+p7_timeline_Destroy(P7_TIMELINE *tl)
+{
+  int t;
+
+  if (tl)
+    {
+      if (tl->track)
+	{
+	  for (t = 0; t < tl->ntracks; t++)
+	    if (tl->track[t])
+	      {
+		if (tl->track[t]->span) free(tl->track[t]->span);
+		free(tl->track[t]);
+	      }
+	  free(tl->track);
+	}
+      free(tl);
+    }
+}
+/*----------------- end, P7_TIMELINE object ---------------------*/
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7TIMELINE_TESTDRIVE
+
+/* utest_ring()
+ * Spans nest and come out in order of closing; a full ring keeps
+ * the newest spans and counts the rest as dropped; overflowing
+ * the nesting depth is harmless.
+ */
+static void
+utest_ring(void)
+{
+  char         msg[] = "p7_timeline.c :: ring unit test failed";
+  P7_TIMELINE *tl    = p7_timeline_Create(2, 5);   // rounds up to 8
+  FILE        *fp    = NULL;
+  int          i;
+
+  if (tl->nevents != 8) esl_fatal(msg);
+
+  p7_timeline_Begin(tl, 0, "outer");
+  p7_timeline_Begin(tl, 0, "inner");
+  p7_timeline_End  (tl, 0);
+  p7_timeline_End  (tl, 0);
+  p7_timeline_End  (tl, 0);                          // unmatched: ignored
+  if (tl->track[0]->nspan != 2)                      esl_fatal(msg);
+  if (strcmp(tl->track[0]->span[0].name, "inner"))   esl_fatal(msg);
+  if (strcmp(tl->track[0]->span[1].name, "outer"))   esl_fatal(msg);
+  if (tl->track[0]->span[1].t0  > tl->track[0]->span[0].t0)  esl_fatal(msg);
+  if (tl->track[0]->span[1].dur < tl->track[0]->span[0].dur) esl_fatal(msg);
+
+  for (i = 0; i < 10; i++) { p7_timeline_Begin(tl, 1, "x"); p7_timeline_End(tl, 1); }
+  if (tl->track[1]->nspan != 10)        esl_fatal(msg);
+  if (p7_timeline_Dropped(tl) != 2)     esl_fatal(msg);
+
+  for (i = 0; i < p7_TIMELINE_MAXDEPTH + 3; i++) p7_timeline_Begin(tl, 0, "deep");
+  for (i = 0; i < p7_TIMELINE_MAXDEPTH + 3; i++) p7_timeline_End  (tl, 0);
+  if (tl->track[0]->depth != 0)                       esl_fatal(msg);
+  if (tl->track[0]->nspan != 2 + p7_TIMELINE_MAXDEPTH) esl_fatal(msg);
+
+  p7_timeline_Begin(NULL, 0, "noop");                 // NULL timeline is a no-op
+  p7_timeline_End  (NULL, 0);
+
+  if ((fp = tmpfile()) == NULL)          esl_fatal(msg);
+  if (p7_timeline_Write(fp, tl) != eslOK) esl_fatal(msg);
+  fclose(fp);
+
+  p7_timeline_Destroy(tl);
+}
+#endif /*p7TIMELINE_TESTDRIVE*/
+/*------------------- end, unit tests ---------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7TIMELINE_TESTDRIVE
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for p7_timeline.c";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  utest_ring();
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_getopts_Destroy(go);
+  exit(0);
+}
+#endif /*p7TIMELINE_TESTDRIVE*/
+/*-------------------- end of test driver ---------------------*/
+
+
+/*****************************************************************
+ * @LICENSE@
+ *
+ * SVN $Id$
+ * SVN $URL$
+ *****************************************************************/
@@ -0,0 +1,62 @@
+/* P7_TIMELINE: an optional per-thread event timeline, written out as
+ * Chrome trace JSON (chrome://tracing, or ui.perfetto.dev).
+ *
+ * A timeline has one track per thread. Each track is a ring buffer
+ * of completed spans (name, start, duration) written only by the
+ * thread that owns it, so recording takes no locks; a full ring
+ * overwrites its oldest spans and counts them as dropped. Spans
+ * nest: Begin()/End() pairs push and pop a small per-track stack.
+ * Nothing is written out until the threads are done and the caller
+ * calls p7_timeline_Write().
+ *
+ * Span names are not copied. They must be string constants, or at
+ * least outlive the timeline.
+ */
+#ifndef p7TIMELINE_INCLUDED
+#define p7TIMELINE_INCLUDED
+
+#include "p7_config.h"
+
+#include <stdio.h>
+
+#define p7_TIMELINE_NEVENTS  65536   // default ring size per track, in spans
+#define p7_TIMELINE_MAXDEPTH 16      // max nesting of open spans per track
+
+typedef struct {
+  const char *name;
+  int64_t     t0;     // start, ns since the timeline was created
+  int64_t     dur;    // duration, ns
+} P7_TLSPAN;
+
+typedef struct {
+  char        name[32];                       // track name, shown as the thread name
+  P7_TLSPAN  *span;                           // ring of completed spans
+  int64_t     nspan;                          // total # of spans ever completed on this track
+  const char *open_name[p7_TIMELINE_MAXDEPTH]; // stack of open spans
+  int64_t     open_t0  [p7_TIMELINE_MAXDEPTH];
+  int         depth;                          // # of open spans
+  int         noverflow;                      // # of Begin()s past MAXDEPTH, ignored along with their End()s
+} P7_TLTRACK;
+
+typedef struct p7_timeline_s {
+  P7_TLTRACK **track;    // track[0..ntracks-1], each allocated separately so threads don't share cache lines
+  int          ntracks;
+  int          nevents;  // ring size of each track; a power of 2
+  int64_t      epoch;    // monotonic clock at creation, ns
+} P7_TIMELINE;
+
+extern P7_TIMELINE *p7_timeline_Create      (int ntracks, int nevents);
+extern int          p7_timeline_SetTrackName(P7_TIMELINE *tl, int t, const char *name);
+extern void         p7_timeline_Begin       (P7_TIMELINE *tl, int t, const char *name);
+extern void         p7_timeline_End         (P7_TIMELINE *tl, int t);
+extern int64_t      p7_timeline_Dropped     (const P7_TIMELINE *tl);
+extern int          p7_timeline_Write       (FILE *ofp, const P7_TIMELINE *tl);
+extern void         p7_timeline_Destroy     (P7_TIMELINE *tl);
+
+#endif /*p7TIMELINE_INCLUDED*/
+/*****************************************************************
+ * @LICENSE@
+ *
+ * SVN $Id$
+ * SVN $URL$
+ *****************************************************************/
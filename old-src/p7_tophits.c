@@ -301,6 +301,125 @@ p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *th)
 }
 
 
+/* Function:  p7_tophits_RemoveDuplicates()
+ * Synopsis:  Mark duplicate domains and hits from overlapping subsequences.
+ *
+ * Purpose:   When a long target is split into overlapping windows
+ *            (each searched separately, with <subseq_start> and
+ *            <window_length> recording the window), a domain that
+ *            falls in an overlap can be found twice, once in each
+ *            window's hit. Sort <th> by sequence index and alignment
+ *            position. Then, for each pair of hits on the same
+ *            sequence that came from different, overlapping windows,
+ *            compare each domain of one with each domain of the
+ *            other. When two domains on the same strand overlap by
+ *            more than 95% of the shorter one on the sequence, and on
+ *            the model (if both have model coords; they're 0 when
+ *            no alignment was done), the lower-scoring one is a
+ *            duplicate: its <is_reported> and <is_included> are set
+ *            <FALSE>. Ties go to the domain from the earlier window.
+ *            Every other domain is left <is_reported> and
+ *            <is_included>, to be thresholded afterwards.
+ *
+ *            A hit with no domains (<ndom> = 0) is compared by its
+ *            placeholder <dcl[0]> and its hit score, as one domain.
+ *
+ *            A hit whose domains are all duplicates is flagged
+ *            <p7_IS_DUPLICATE>. Hits with some unique domains are
+ *            kept, so a domain found only in the lower-scoring of two
+ *            windows isn't lost. Flagged hits remain in the list;
+ *            callers skip them. Upon return <th> is sorted by
+ *            sequence index and position.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_tophits_RemoveDuplicates(P7_TOPHITS *th)
+{
+  P7_HIT    *hi, *hj;
+  P7_DOMAIN *di, *dj;
+  int        s_i, e_i, s_j, e_j, tmp;
+  int        dir_i, dir_j;
+  int        len_i, len_j, hmmlen_i, hmmlen_j;
+  int        olen, hmmolen;
+  float      sc_i, sc_j;
+  int        maxwin = 0;
+  int        i, j, d, e, nleft;
+
+  if (th->N < 2) return eslOK;
+  p7_tophits_SortBySeqidxAndAlipos(th);
+
+  for (i = 0; i < th->N; i++)
+    {
+      maxwin = ESL_MAX(maxwin, th->hit[i]->window_length);
+      for (d = 0; d < ESL_MAX(1, th->hit[i]->ndom); d++)
+	th->hit[i]->dcl[d].is_reported = th->hit[i]->dcl[d].is_included = TRUE;
+    }
+
+  for (i = 1; i < th->N; i++)
+    {
+      hi = th->hit[i];
+
+      /* Hits are sorted by their first domain's <ia>, which lies in
+       * the hit's window; so once hj's <ia> is a whole window length
+       * upstream of hi's window, no earlier hit's window can overlap it.
+       */
+      for (j = i-1; j >= 0; j--)
+	{
+	  hj = th->hit[j];
+	  if (hj->seqidx != hi->seqidx)                              break;
+	  if (hj->dcl[0].ia + maxwin < hi->subseq_start)            break;
+	  if (hj->subseq_start == hi->subseq_start)                  continue;
+	  if (hj->subseq_start + hj->window_length <= hi->subseq_start ||
+	      hi->subseq_start + hi->window_length <= hj->subseq_start) continue;
+
+	  for (d = 0; d < ESL_MAX(1, hi->ndom); d++)
+	    for (e = 0; e < ESL_MAX(1, hj->ndom); e++)
+	      {
+		di = &(hi->dcl[d]);
+		dj = &(hj->dcl[e]);
+		if (! di->is_reported || ! dj->is_reported) continue;
+
+		s_i = di->ia;  e_i = di->ib;  dir_i = (s_i <= e_i ? 1 : -1);
+		s_j = dj->ia;  e_j = dj->ib;  dir_j = (s_j <= e_j ? 1 : -1);
+		if (dir_i != dir_j) continue;
+		if (dir_i == -1) { tmp = s_i; s_i = e_i; e_i = tmp; }
+		if (dir_j == -1) { tmp = s_j; s_j = e_j; e_j = tmp; }
+
+		len_i = e_i - s_i + 1;
+		len_j = e_j - s_j + 1;
+		olen  = ESL_MIN(e_i, e_j) - ESL_MAX(s_i, s_j) + 1;
+		if ((float) olen / (float) ESL_MIN(len_i, len_j) <= 0.95) continue;
+
+		if (di->ka && dj->ka)
+		  {
+		    hmmlen_i = di->kb - di->ka + 1;
+		    hmmlen_j = dj->kb - dj->ka + 1;
+		    hmmolen  = ESL_MIN(di->kb, dj->kb) - ESL_MAX(di->ka, dj->ka) + 1;
+		    if ((float) hmmolen / (float) ESL_MIN(hmmlen_i, hmmlen_j) <= 0.95) continue;
+		  }
+
+		sc_i = (hi->ndom ? di->bitscore : hi->score);
+		sc_j = (hj->ndom ? dj->bitscore : hj->score);
+		if (sc_i > sc_j || (sc_i == sc_j && hi->subseq_start < hj->subseq_start))
+		  dj->is_reported = dj->is_included = FALSE;
+		else
+		  di->is_reported = di->is_included = FALSE;
+	      }
+	}
+    }
+
+  for (i = 0; i < th->N; i++)
+    {
+      hi = th->hit[i];
+      for (nleft = 0, d = 0; d < ESL_MAX(1, hi->ndom); d++)
+	if (hi->dcl[d].is_reported) nleft++;
+      if (! nleft) hi->flags |= p7_IS_DUPLICATE;
+    }
+  return eslOK;
+}
+
+
 /* Function:  p7_tophits_Merge()
  * Synopsis:  Merge two top hits lists.
  *
@@ -1028,6 +1147,9 @@ main(int argc, char **argv)
   P7_TOPHITS     *h1       = NULL;
   P7_TOPHITS     *h2       = NULL;
   P7_TOPHITS     *h3       = NULL;
+  P7_TOPHITS     *h4       = NULL;
+  P7_TOPHITS     *h5       = NULL;
+  P7_HIT         *hit      = NULL;
   char            name[]   = "not_unique_name";
   char            acc[]    = "not_unique_acc";
   char            desc[]   = "Test description for the purposes of making the test driver allocate space";
@@ -1067,9 +1189,65 @@ main(int argc, char **argv)
   
   if (p7_tophits_GetMaxNameLength(h3) != strlen(name)) esl_fatal("GetMaxNameLength() failed");
 
+  /* Two windows of the same target, overlapping; the domain found in
+   * both should be flagged once, in the lower scoring hit. A third
+   * hit, on another target, is left alone.
+   */
+  h4 = p7_tophits_Create(p7_TOPHITS_DEFAULT_INIT_ALLOC);
+  for (i = 0; i < 3; i++)
+    {
+      p7_tophits_CreateNextHit(h4, &hit);
+      hit->seqidx          = (i == 2 ? 1 : 0);
+      hit->subseq_start    = (i == 1 ? 901 : 1);
+      hit->window_length   = 1000;
+      hit->score           = (i == 1 ? 30.0 : 20.0);
+      hit->ndom            = 1;
+      hit->dcl             = p7_domain_Create(1);
+      hit->dcl[0].ia       = 950;   hit->dcl[0].ib     = 1000;
+      hit->dcl[0].ka       = 1;     hit->dcl[0].kb     = 50;
+      hit->dcl[0].bitscore = hit->score;
+    }
+  p7_tophits_RemoveDuplicates(h4);
+  for (i = 0; i < h4->N; i++)
+    if ( ((h4->unsrt[i].flags & p7_IS_DUPLICATE) != 0) != (i == 0)) esl_fatal("RemoveDuplicates() failed");
+
+  /* A two-domain window 1..1000, and the window 901..1900 that
+   * overlaps it. The first window's second domain, 950..1000, is
+   * also found, with a higher score, by the second window; its first
+   * domain, 100..200, is only in the first window. Only the
+   * duplicated domain may be dropped, and the first hit must stay.
+   */
+  h5 = p7_tophits_Create(p7_TOPHITS_DEFAULT_INIT_ALLOC);
+  for (i = 0; i < 2; i++)
+    {
+      p7_tophits_CreateNextHit(h5, &hit);
+      hit->seqidx          = 0;
+      hit->subseq_start    = (i == 0 ? 1 : 901);
+      hit->window_length   = 1000;
+      hit->score           = (i == 0 ? 40.0 : 30.0);
+      hit->ndom            = (i == 0 ? 2 : 1);
+      hit->dcl             = p7_domain_Create(hit->ndom);
+      hit->dcl[0].ia       = (i == 0 ? 100 : 950);  hit->dcl[0].ib = (i == 0 ? 200 : 1000);
+      hit->dcl[0].ka       = 1;                     hit->dcl[0].kb = 50;
+      hit->dcl[0].bitscore = (i == 0 ? 25.0 : 30.0);
+      if (i == 0) {
+	hit->dcl[1].ia       = 950;   hit->dcl[1].ib     = 1000;
+	hit->dcl[1].ka       = 1;     hit->dcl[1].kb     = 50;
+	hit->dcl[1].bitscore = 15.0;
+      }
+    }
+  p7_tophits_RemoveDuplicates(h5);
+  if (   h5->unsrt[0].flags & p7_IS_DUPLICATE)  esl_fatal("RemoveDuplicates() dropped a window with a unique domain");
+  if (   h5->unsrt[1].flags & p7_IS_DUPLICATE)  esl_fatal("RemoveDuplicates() failed");
+  if (!  h5->unsrt[0].dcl[0].is_reported)       esl_fatal("RemoveDuplicates() dropped a unique domain");
+  if (   h5->unsrt[0].dcl[1].is_reported)       esl_fatal("RemoveDuplicates() kept the lower scoring duplicate domain");
+  if (!  h5->unsrt[1].dcl[0].is_reported)       esl_fatal("RemoveDuplicates() dropped the higher scoring duplicate domain");
+
   p7_tophits_Destroy(h1);
   p7_tophits_Destroy(h2);
   p7_tophits_Destroy(h3);
+  p7_tophits_Destroy(h4);
+  p7_tophits_Destroy(h5);
   esl_randomness_Destroy(r);
   esl_getopts_Destroy(go);
 
@@ -94,6 +94,7 @@ extern int         p7_tophits_CreateNextHit(P7_TOPHITS *th, P7_HIT **ret_hit);
 extern int         p7_tophits_SortBySortkey(P7_TOPHITS *th);
 extern int         p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *th);
 extern int         p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *th);
+extern int         p7_tophits_RemoveDuplicates(P7_TOPHITS *th);
 extern int         p7_tophits_Merge(P7_TOPHITS *th1, P7_TOPHITS *th2);
 extern int         p7_tophits_GetMaxPositionLength(P7_TOPHITS *th);
 extern int         p7_tophits_GetMaxNameLength(P7_TOPHITS *th);
@@ -1,10 +1,88 @@
 
 #include "easel.h"
 #include "esl_dsqdata.h"
+#include "esl_exponential.h"
 
 #include "hmmer.h"
 
+#include <math.h>
 #include <pthread.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* CHUNKREF   (struct chunkref_s)
+ * Reference count on a chunk that holds a split long target. The chunk
+ * can't be recycled until its owner and every queued window are done.
+ */
+typedef struct chunkref_s {
+  ESL_DSQDATA_CHUNK *chu;
+  int                nref;   // one for the worker that read the chunk, plus one per unfinished window
+} CHUNKREF;
+
+
+/* SPLIT   (struct split_s)
+ * One overlapping window of a long target, queued for any worker.
+ */
+typedef struct split_s {
+  CHUNKREF *ref;      // chunk that the target is in
+  ESL_DSQ  *dsq;      // the whole target, 1..L
+  int64_t   seqidx;   // index of the target in the database
+  int64_t   start;    // window is start..start+len-1 on the target
+  int       len;
+} SPLIT;
+
+
+/* DEFERRED   (struct deferred_s)
+ * A comparison that a worker set aside: either because the memory
+ * governor refused its reservation, or because its predicted main
+ * engine cost put it in quarantine. It holds its own copy of the
+ * (sub)sequence, since the chunk it came from gets recycled, and if
+ * it got through the filters, their sparse mask and scores, so it
+ * picks up again at the main engine.
+ */
+typedef struct deferred_s {
+  ESL_DSQ            *dsq;           // copy of the target residues, 1..L
+  int                 L;
+  int64_t             seqidx;
+  int64_t             subseq_start;
+  P7_ENGINE_FILTERED *flt;           // the Overthruster's result; NULL if the governor refused before it finished
+} DEFERRED;
+
+
+/* DEFQUEUE   (struct defqueue_s)
+ * A FIFO of deferred comparisons: d[head..n-1] are waiting.
+ * Protected by the crew's <qlock>.
+ */
+typedef struct defqueue_s {
+  DEFERRED *d;
+  int       head;
+  int       n;
+  int       nalloc;
+} DEFQUEUE;
+
+
+/* CREWOPTS   (struct crewopts_s)
+ * How main() wants the crew to search, set up once from the command
+ * line and passed to crew_Create(). Pointers are references; the
+ * crew doesn't free them.
+ */
+typedef struct crewopts_s {
+  P7_SCOREDATA *ssvdata;     // SSV score data for windowed long targets, or NULL
+  int           wmin;        // search targets of length >= wmin in SSV windows; 0 = never
+  int           splitlen;    // split targets longer than this across the crew; 0 = never
+  int           overlap;     // split windows overlap by this many residues
+  int           do_cache;    // TRUE to size checkpoint matrices to each thread's share of cache
+  P7_MEMGOV    *mg;          // memory budget shared by the engines, or NULL
+  double        qcost;       // quarantine comparisons with predicted main engine cost > qcost; 0 = never
+  FILE         *qlogfp;      // log of quarantined comparisons, or NULL
+  int           do_stats;    // engine stats to collect: filter funnel and mask density ...
+  int           do_timing;   //   ... per-stage times
+  int           do_counters; //   ... per-stage hardware counters
+  int           do_memory;   //   ... DP memory high-water marks
+  int           do_latency;  //   ... per-comparison latencies
+} CREWOPTS;
+
 
 /* CREW   (struct crew_s)
  * Shared data amongst the threads.
@@ -12,6 +90,27 @@
 typedef struct crew_s {
   int               nworkers;
   struct worker_s **uw;
+
+  P7_SCOREDATA     *ssvdata;  // SSV score data for windowed long targets, or NULL. Read-only, shared.
+  int               wmin;     // targets of length >= wmin are searched in SSV windows; 0 = never
+
+  int               splitlen; // targets longer than this are split into windows for the whole crew; 0 = never
+  int               overlap;  // split windows overlap by this many residues
+  pthread_mutex_t   qlock;    // protects the split queue, and CHUNKREF counts
+  SPLIT            *q;        // queue of windows: q[qhead..qn-1] are waiting
+  int               qhead;
+  int               qn;
+  int               qalloc;
+
+  P7_MEMGOV        *mg;       // memory budget shared by the workers' engines, or NULL. Reference.
+  DEFQUEUE          big;      // comparisons deferred to the big-memory worker
+
+  double            qcost;    // comparisons with predicted main engine cost > qcost are quarantined; 0 = never
+  DEFQUEUE          slow;     // quarantined comparisons, run by one worker at a time between chunks, and by all at EOF
+  int               slowbusy; // TRUE while a worker runs a quarantined comparison before EOF. Protected by <qlock>.
+  FILE             *qlogfp;   // optional log of every quarantined comparison's cost, or NULL. Protected by <qlock>.
+
+  P7_TIMELINE      *tl;       // optional timeline, one track per worker, or NULL. Each worker writes only its own track.
 } CREW;
 
 
@@ -30,28 +129,70 @@ typedef struct worker_s {
   P7_OPROFILE *om;   // clone
 
   P7_ENGINE   *eng;  // independent
+  P7_TOPHITS  *th;   // hits found by this worker
+
+  P7_HMM_WINDOWLIST wl;  // SSV windows on the current long target
+
+  int64_t      nchunks;  // chunks this worker read
+  int64_t      nseq;     //   ... and sequences in them
+  int64_t      nres;     //   ... and residues
+  double       t_read;   // wall time blocked in esl_dsqdata_Read()
+  double       t_proc;   // wall time processing chunks and split windows
+  double       t_eof;    // wall time from EOF to the end of the thread
 
   char errbuf[eslERRBUFSIZE];
   int status;
 } WORKER;
 
-static CREW *crew_Create (ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, int n);
+static CREW *crew_Create (ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, const CREWOPTS *opts, int n);
 static int   crew_Start  (CREW *crew);
 static int   crew_Finish (CREW *crew);
 static void  crew_Destroy(CREW *crew);
 
+static int   crew_Split    (CREW *crew, CHUNKREF *ref, ESL_DSQ *dsq, int L, int64_t seqidx);
+static int   crew_NextSplit(CREW *crew, SPLIT *ret_sp);
+static void  crew_Release  (CREW *crew, CHUNKREF *ref);
+
+static int   crew_Defer       (CREW *crew, DEFQUEUE *dq, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start, P7_ENGINE_FILTERED *flt);
+static int   crew_NextDeferred(CREW *crew, DEFQUEUE *dq, DEFERRED *ret_d);
+static int   crew_RunDeferred (CREW *crew);
+static int   crew_RunQuarantined(WORKER *uw, int before_eof);
+
 static void *search_thread(void *p);
+static int   search_seq    (WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start);
+static int   search_one    (WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start, int run_now, P7_ENGINE_FILTERED *flt);
+static int   search_windows(WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start);
 
 static CREW *
-crew_Create(ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, int n)
+crew_Create(ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, const CREWOPTS *opts, int n)
 {
   CREW    *crew = NULL;
+  P7_ENGINE_PARAMS *prm = NULL;
+  P7_ENGINE_STATS  *stats = NULL;
   int      u;
   int      status;
 
   ESL_ALLOC(crew, sizeof(CREW));
   crew->nworkers  = n;
   crew->uw        = NULL;
+  crew->ssvdata   = opts->ssvdata;  // reference
+  crew->wmin      = opts->wmin;
+  crew->splitlen  = opts->splitlen;
+  crew->overlap   = opts->overlap;
+  crew->q         = NULL;
+  crew->qhead     = 0;
+  crew->qn        = 0;
+  crew->qalloc    = 0;
+  crew->mg        = opts->mg;       // reference
+  crew->qcost     = opts->qcost;
+  crew->qlogfp    = opts->qlogfp;   // reference
+  crew->tl        = NULL;
+  crew->big.d     = crew->slow.d    = NULL;
+  crew->big.head  = crew->slow.head = 0;
+  crew->big.n     = crew->slow.n    = 0;
+  crew->big.nalloc= crew->slow.nalloc = 0;
+  crew->slowbusy  = FALSE;
+  pthread_mutex_init(&(crew->qlock), NULL);
 
   ESL_ALLOC(crew->uw, sizeof(WORKER *) * n);
   for (u = 0; u < n; u++) crew->uw[u] = NULL;
@@ -64,6 +205,10 @@ crew_Create(ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, int n)
       crew->uw[u]->gm  = NULL;
       crew->uw[u]->om  = NULL;
       crew->uw[u]->eng = NULL;
+      crew->uw[u]->th  = NULL;
+      crew->uw[u]->wl.windows = NULL;
+      crew->uw[u]->nchunks = crew->uw[u]->nseq = crew->uw[u]->nres = 0;
+      crew->uw[u]->t_read  = crew->uw[u]->t_proc = crew->uw[u]->t_eof = 0.;
       
       if (u == 0) {
 	crew->uw[u]->bg = bg;
@@ -74,7 +219,23 @@ crew_Create(ESL_DSQDATA *dd, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg, int n)
 	crew->uw[u]->gm = p7_profile_Clone(gm);
 	crew->uw[u]->om = p7_oprofile_Clone(om);
       }
-      crew->uw[u]->eng = p7_engine_Create(gm->abc, NULL, NULL, 200, 400);
+      if (opts->do_cache || opts->do_timing || opts->do_counters || opts->do_memory || opts->do_latency) {  // each engine owns (and frees) its own params
+	if ((prm = p7_engine_params_Create(NULL)) == NULL) goto ERROR;
+	if (opts->do_cache) prm->cache_nthreads = n;
+	prm->do_timing   = opts->do_timing;
+	prm->do_counters = opts->do_counters;
+	prm->do_memory   = opts->do_memory;
+	prm->do_latency  = opts->do_latency;
+      }
+      if (opts->do_stats || opts->do_timing || opts->do_counters || opts->do_memory || opts->do_latency) {  // ... and its own stats
+	if ((stats = p7_engine_stats_Create()) == NULL) goto ERROR;
+      }
+      crew->uw[u]->eng = p7_engine_Create(gm->abc, prm, stats, 200, 400);
+      prm   = NULL;
+      stats = NULL;
+      if (opts->mg) p7_engine_SetMemGovernor(crew->uw[u]->eng, opts->mg);
+      crew->uw[u]->th  = p7_tophits_Create(p7_TOPHITS_DEFAULT_INIT_ALLOC);
+      if (opts->wmin && p7_hmmwindow_init(&(crew->uw[u]->wl)) != eslOK) goto ERROR;
     }
   return crew;
 
@@ -122,62 +283,329 @@ crew_Destroy(CREW *crew)
 	  if (u>0) p7_profile_Destroy(crew->uw[u]->gm);
 	  if (u>0) p7_oprofile_Destroy(crew->uw[u]->om);
 	  p7_engine_Destroy(crew->uw[u]->eng);
+	  p7_tophits_Destroy(crew->uw[u]->th);
+	  if (crew->uw[u]->wl.windows) free(crew->uw[u]->wl.windows);
 	  free(crew->uw[u]);
 	}
       }
     free(crew->uw);
   }
+  if (crew->q) free(crew->q);
+  if (crew->big.d) {
+    for (u = crew->big.head; u < crew->big.n; u++) { free(crew->big.d[u].dsq); p7_engine_filtered_Destroy(crew->big.d[u].flt); }
+    free(crew->big.d);
+  }
+  if (crew->slow.d) {
+    for (u = crew->slow.head; u < crew->slow.n; u++) { free(crew->slow.d[u].dsq); p7_engine_filtered_Destroy(crew->slow.d[u].flt); }
+    free(crew->slow.d);
+  }
+  pthread_mutex_destroy(&(crew->qlock));
   free(crew);
 }
 
 
+/* crew_Split()
+ * Split long target <dsq> of length <L> (sequence number <seqidx>),
+ * which lives in the chunk referenced by <ref>, into windows of
+ * <crew->splitlen> residues overlapping by <crew->overlap>, and queue
+ * them for any worker to take. Each window holds a reference on the
+ * chunk. A domain up to <overlap> long is wholly inside at least one
+ * window; one found in two windows is removed afterwards by
+ * p7_tophits_RemoveDuplicates().
+ */
+static int
+crew_Split(CREW *crew, CHUNKREF *ref, ESL_DSQ *dsq, int L, int64_t seqidx)
+{
+  int64_t start;
+  int     len;
+  int     status;
+
+  pthread_mutex_lock(&(crew->qlock));
+  for (start = 1; ; start += crew->splitlen - crew->overlap)
+    {
+      len = (int) ESL_MIN(crew->splitlen, L - start + 1);
+
+      if (crew->qn == crew->qalloc)
+	{
+	  crew->qalloc = (crew->qalloc ? crew->qalloc * 2 : 64);
+	  ESL_REALLOC(crew->q, sizeof(SPLIT) * crew->qalloc);
+	}
+      crew->q[crew->qn].ref    = ref;
+      crew->q[crew->qn].dsq    = dsq;
+      crew->q[crew->qn].seqidx = seqidx;
+      crew->q[crew->qn].start  = start;
+      crew->q[crew->qn].len    = len;
+      crew->qn++;
+      ref->nref++;
+
+      if (start + len - 1 >= L) break;
+    }
+  pthread_mutex_unlock(&(crew->qlock));
+  return eslOK;
+
+ ERROR:
+  pthread_mutex_unlock(&(crew->qlock));
+  return status;
+}
+
+
+/* crew_NextSplit()
+ * Take the next queued window, if any, into <ret_sp>.
+ * Returns <eslOK> if one was taken, <eslEOF> if the queue is empty.
+ */
+static int
+crew_NextSplit(CREW *crew, SPLIT *ret_sp)
+{
+  int status = eslEOF;
+
+  pthread_mutex_lock(&(crew->qlock));
+  if (crew->qhead < crew->qn)
+    {
+      *ret_sp = crew->q[crew->qhead++];
+      if (crew->qhead == crew->qn) crew->qhead = crew->qn = 0;
+      status = eslOK;
+    }
+  pthread_mutex_unlock(&(crew->qlock));
+  return status;
+}
+
+
+/* crew_Release()
+ * Drop one reference on a split chunk; the last one out recycles it.
+ */
+static void
+crew_Release(CREW *crew, CHUNKREF *ref)
+{
+  int nref;
+
+  pthread_mutex_lock(&(crew->qlock));
+  nref = --(ref->nref);
+  pthread_mutex_unlock(&(crew->qlock));
+
+  if (nref == 0)
+    {
+      esl_dsqdata_Recycle(crew->uw[0]->dd, ref->chu);
+      free(ref);
+    }
+}
+
+
+/* crew_Defer()
+ * Set aside a comparison on queue <dq>, copying its residues. The
+ * queue takes <flt>, the Overthruster's result, if it's non-NULL;
+ * on an error, it's freed.
+ */
+static int
+crew_Defer(CREW *crew, DEFQUEUE *dq, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start, P7_ENGINE_FILTERED *flt)
+{
+  ESL_DSQ *copy = NULL;
+  int      status;
+
+  if ((copy = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) { p7_engine_filtered_Destroy(flt); return eslEMEM; }
+  memcpy(copy+1, dsq+1, sizeof(ESL_DSQ) * L);
+  copy[0] = copy[L+1] = eslDSQ_SENTINEL;
+
+  pthread_mutex_lock(&(crew->qlock));
+  if (dq->n == dq->nalloc)
+    {
+      dq->nalloc = (dq->nalloc ? dq->nalloc * 2 : 16);
+      ESL_REALLOC(dq->d, sizeof(DEFERRED) * dq->nalloc);
+    }
+  dq->d[dq->n].dsq          = copy;
+  dq->d[dq->n].L            = L;
+  dq->d[dq->n].seqidx       = seqidx;
+  dq->d[dq->n].subseq_start = subseq_start;
+  dq->d[dq->n].flt          = flt;
+  dq->n++;
+  pthread_mutex_unlock(&(crew->qlock));
+  return eslOK;
+
+ ERROR:
+  pthread_mutex_unlock(&(crew->qlock));
+  p7_engine_filtered_Destroy(flt);
+  free(copy);
+  return status;
+}
+
+
+/* crew_NextDeferred()
+ * Take the next comparison off queue <dq>, if any, into <ret_d>;
+ * caller frees <ret_d->dsq>, and passes <ret_d->flt> on to
+ * search_one(), which frees it.
+ * Returns <eslOK> if one was taken, <eslEOF> if the queue is empty.
+ */
+static int
+crew_NextDeferred(CREW *crew, DEFQUEUE *dq, DEFERRED *ret_d)
+{
+  int status = eslEOF;
+
+  pthread_mutex_lock(&(crew->qlock));
+  if (dq->head < dq->n)
+    {
+      *ret_d = dq->d[dq->head++];
+      if (dq->head == dq->n) dq->head = dq->n = 0;
+      status = eslOK;
+    }
+  pthread_mutex_unlock(&(crew->qlock));
+  return status;
+}
+
+
+/* crew_RunDeferred()
+ * After the crew has finished, run the comparisons that were
+ * deferred for memory one at a time in worker 0, as a big-memory
+ * worker: its engine is detached from the governor, so it can take
+ * all the memory that the rest of the crew has now released.
+ */
+static int
+crew_RunDeferred(CREW *crew)
+{
+  WORKER  *uw = crew->uw[0];
+  DEFERRED d;
+  int      status;
+
+  p7_engine_SetMemGovernor(uw->eng, NULL);
+  while (crew_NextDeferred(crew, &(crew->big), &d) == eslOK)
+    {
+      p7_timeline_Begin(crew->tl, uw->idx, "deferred");
+      status = search_one(uw, d.dsq, d.L, d.seqidx, d.subseq_start, TRUE, d.flt);
+      p7_timeline_End(crew->tl, uw->idx);
+      free(d.dsq);
+      if (status != eslOK && status != eslFAIL) return status;
+    }
+  return eslOK;
+}
+
+
+/* crew_RunQuarantined()
+ * Run quarantined comparisons in worker <uw>. At EOF
+ * (<before_eof> FALSE), run them until the queue is empty. Before
+ * EOF, run at most one, and only if no other worker is running one
+ * and there's another worker to keep the regular targets moving;
+ * so a worker does one between chunks now and then, and the
+ * quarantine queue doesn't all wait for EOF.
+ */
+static int
+crew_RunQuarantined(WORKER *uw, int before_eof)
+{
+  CREW    *crew   = uw->crew;
+  int      take   = TRUE;
+  int      status = eslOK;
+  DEFERRED d;
+
+  if (before_eof)
+    {
+      pthread_mutex_lock(&(crew->qlock));
+      take = (crew->nworkers > 1 && ! crew->slowbusy && crew->slow.head < crew->slow.n);
+      if (take) crew->slowbusy = TRUE;
+      pthread_mutex_unlock(&(crew->qlock));
+      if (! take) return eslOK;
+    }
+
+  while (crew_NextDeferred(crew, &(crew->slow), &d) == eslOK)
+    {
+      p7_timeline_Begin(crew->tl, uw->idx, "quarantined");
+      status = search_one(uw, d.dsq, d.L, d.seqidx, d.subseq_start, TRUE, d.flt);
+      p7_timeline_End(crew->tl, uw->idx);
+      free(d.dsq);
+      if (status == eslFAIL) status = eslOK;
+      if (status != eslOK || before_eof) break;
+    }
+
+  if (before_eof)
+    {
+      pthread_mutex_lock(&(crew->qlock));
+      crew->slowbusy = FALSE;
+      pthread_mutex_unlock(&(crew->qlock));
+    }
+  return status;
+}
+
+
 static void *
 search_thread(void *p)
 {
-  ESL_STOPWATCH     *w   = esl_stopwatch_Create();
-  WORKER            *uw  = (WORKER *) p;  
-  ESL_DSQDATA       *dd  = uw->dd;
-  P7_PROFILE        *gm  = uw->gm;
-  P7_OPROFILE       *om  = uw->om;
-  P7_BG             *bg  = uw->bg;
-  P7_ENGINE         *eng = uw->eng;
-  ESL_DSQDATA_CHUNK *chu = NULL;
+  ESL_STOPWATCH     *w    = esl_stopwatch_Create();
+  WORKER            *uw   = (WORKER *) p;  
+  CREW              *crew = uw->crew;
+  ESL_DSQDATA       *dd   = uw->dd;
+  ESL_DSQDATA_CHUNK *chu  = NULL;
+  CHUNKREF          *ref  = NULL;
+  SPLIT              sp;
   int      i;
   int      status;
 
   esl_stopwatch_Start(w);
 
-  while (( status = esl_dsqdata_Read(dd, &chu)) == eslOK)  
+  while (1)
     {
+      /* Windows of split long targets come first, so a long target
+       * isn't left waiting while other workers read ahead.
+       */
+      while (crew_NextSplit(crew, &sp) == eslOK)
+	{
+	  p7_timeline_Begin(crew->tl, uw->idx, "split window");
+	  search_seq(uw, sp.dsq + sp.start - 1, sp.len, sp.seqidx, sp.start);
+	  crew_Release(crew, sp.ref);
+	  p7_timeline_End(crew->tl, uw->idx);
+	}
+      /* Then maybe one quarantined comparison, if no other worker
+       * is on one.
+       */
+      crew_RunQuarantined(uw, TRUE);
       esl_stopwatch_Stop(w);
-      printf("thread %d:  read time: %.5f sec\n", uw->idx, esl_stopwatch_GetElapsed(w));
+      uw->t_proc += esl_stopwatch_GetElapsed(w);
       esl_stopwatch_Start(w);
 
-      for (i = 0; i < chu->N; i++)
-	{
-	  p7_bg_SetLength(bg, (int) chu->L[i]);            // TODO: remove need for cast
-	  p7_oprofile_ReconfigLength(om, (int) chu->L[i]); //         (ditto)
-	  
-	  status = p7_engine_Overthruster(eng, chu->dsq[i], (int) chu->L[i], om, bg);  
-	  if (status == eslFAIL) { 
-	    p7_engine_Reuse(eng);
-	    continue;
-	  }
+      p7_timeline_Begin(crew->tl, uw->idx, "read");
+      status = esl_dsqdata_Read(dd, &chu);
+      p7_timeline_End(crew->tl, uw->idx);
 
-	  p7_profile_SetLength(gm, (int) chu->L[i]);
-	  status = p7_engine_Main(eng, chu->dsq[i], (int) chu->L[i], gm); 
-
-	  p7_engine_Reuse(eng);
-	}
       esl_stopwatch_Stop(w);
-      printf("thread %d: chunk time: %.5f sec\n", uw->idx, esl_stopwatch_GetElapsed(w));
+      uw->t_read += esl_stopwatch_GetElapsed(w);
       esl_stopwatch_Start(w);
+      if (status != eslOK) break;
+
+      p7_timeline_Begin(crew->tl, uw->idx, "chunk");
+      uw->nchunks++;
+      uw->nseq += chu->N;
+      ref = NULL;
+      for (i = 0; i < chu->N; i++)
+	{
+	  uw->nres += chu->L[i];
+	  if (crew->splitlen && chu->L[i] > crew->splitlen)
+	    {
+	      if (! ref) {
+		if ((ref = malloc(sizeof(CHUNKREF))) == NULL) esl_fatal("malloc failed");
+		ref->chu  = chu;
+		ref->nref = 1;
+	      }
+	      if (crew_Split(crew, ref, chu->dsq[i], (int) chu->L[i], chu->i0 + i) != eslOK) esl_fatal("crew_Split failed");
+	      continue;
+	    }
+	  search_seq(uw, chu->dsq[i], (int) chu->L[i], chu->i0 + i, 1);
+	}
 
-      esl_dsqdata_Recycle(dd, chu);
+      if (ref) crew_Release(crew, ref);
+      else     esl_dsqdata_Recycle(dd, chu);
+      p7_timeline_End(crew->tl, uw->idx);
     }
+
+  /* At EOF, help finish any windows still queued, then the rest of
+   * the quarantined comparisons. A worker that queues windows or
+   * quarantines comparisons after this point finishes them itself.
+   */
+  p7_timeline_Begin(crew->tl, uw->idx, "eof");
+  while (crew_NextSplit(crew, &sp) == eslOK)
+    {
+      search_seq(uw, sp.dsq + sp.start - 1, sp.len, sp.seqidx, sp.start);
+      crew_Release(crew, sp.ref);
+    }
+  crew_RunQuarantined(uw, FALSE);
+  p7_timeline_End(crew->tl, uw->idx);
   
   esl_stopwatch_Stop(w);
-  printf("thread %d:   eof time: %.5f sec\n", uw->idx, esl_stopwatch_GetElapsed(w));
+  uw->t_eof = esl_stopwatch_GetElapsed(w);
   esl_stopwatch_Destroy(w);
 
   uw->errbuf[0] = '\0';
@@ -186,11 +614,234 @@ search_thread(void *p)
 }
 
 
+/* search_seq()
+ * Search target <dsq> of length <L>, which is sequence number <seqidx>
+ * or a subsequence of it starting at <subseq_start> (1 for a whole
+ * sequence); store any hit in the worker's <th>.
+ */
+static int
+search_seq(WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start)
+{
+  if (uw->crew->wmin && L >= uw->crew->wmin)
+    return search_windows(uw, dsq, L, seqidx, subseq_start);
+  return search_one(uw, dsq, L, seqidx, subseq_start, FALSE, FALSE);
+}
+
+
+/* search_one()
+ * Run the engine on <dsq> of length <L>, which is sequence <seqidx> or
+ * its subsequence starting at <subseq_start>, with no further
+ * windowing. If the engine's memory governor refuses, the comparison
+ * is deferred to the big-memory worker. If its predicted main engine
+ * cost is over the crew's quarantine threshold, it's put in the
+ * quarantine queue instead of running now, unless <run_now> is TRUE
+ * (it's already been deferred); when it does run, its predicted and
+ * actual cost are logged.
+ *
+ * A comparison that passed the filters before it was deferred keeps
+ * their result, and when it runs again, its <flt> is given here and
+ * it resumes at the main engine. <flt> is consumed.
+ */
+static int
+search_one(WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start, int run_now, P7_ENGINE_FILTERED *flt)
+{
+  CREW          *crew = uw->crew;
+  P7_PROFILE    *gm   = uw->gm;
+  P7_OPROFILE   *om   = uw->om;
+  P7_BG         *bg   = uw->bg;
+  P7_ENGINE     *eng  = uw->eng;
+  ESL_STOPWATCH *w    = NULL;
+  double         cost = 0.;
+  int            do_quarantine = FALSE;
+  int            filtered;
+  int            status;
+
+  if (flt)
+    status = p7_engine_AttachFiltered(eng, flt);
+  else
+    {
+      p7_bg_SetLength(bg, L);
+      p7_oprofile_ReconfigLength(om, L);
+	  
+      p7_timeline_Begin(crew->tl, uw->idx, "overthruster");
+      status = p7_engine_Overthruster(eng, dsq, L, om, bg);  
+      p7_timeline_End(crew->tl, uw->idx);
+    }
+  filtered = (status == eslOK);
+  if (status == eslOK && crew->qcost > 0.)
+    {
+      cost = p7_engine_PredictMainCost(eng);
+      if (cost > crew->qcost)
+	{
+	  if (! run_now)       do_quarantine = TRUE;
+	  else if (crew->qlogfp) { w = esl_stopwatch_Create(); esl_stopwatch_Start(w); }
+	}
+    }
+
+  if (status == eslOK && ! do_quarantine)
+    {
+      p7_profile_SetLength(gm, L);
+      p7_timeline_Begin(crew->tl, uw->idx, "main");
+      status = p7_engine_Main(eng, dsq, L, gm); 
+      p7_timeline_End(crew->tl, uw->idx);
+      if (status == eslOK) p7_engine_StoreHit(eng, seqidx, subseq_start, L, uw->th);
+    }
+
+  if (w)
+    {
+      esl_stopwatch_Stop(w);
+      pthread_mutex_lock(&(crew->qlock));
+      fprintf(crew->qlogfp, "%-10" PRId64 " %10" PRId64 " %8d %10" PRId64 " %8d %6d %8.2f %12.0f %10.4f %s\n",
+	      seqidx, subseq_start, L, eng->sm->ncells, eng->sm->nrow, eng->sm->S,
+	      (eng->ffsc - eng->biassc) / eslCONST_LOG2, cost, esl_stopwatch_GetElapsed(w),
+	      (status == eslENORESULT ? "deferred" : "ok"));
+      pthread_mutex_unlock(&(crew->qlock));
+      esl_stopwatch_Destroy(w);
+    }
+  flt = NULL;                                      // the engine took the one we were given, if any
+  if (status != eslENORESULT && ! do_quarantine)   // deferred comparisons are timed when they do run
+    p7_engine_RecordLatency(eng, seqidx, subseq_start);
+  else if (filtered && p7_engine_DetachFiltered(eng, &flt) != eslOK)
+    return eslEMEM;
+  p7_engine_Reuse(eng);
+
+  if      (status == eslENORESULT) status = crew_Defer(crew, &(crew->big),  dsq, L, seqidx, subseq_start, flt);
+  else if (do_quarantine)          status = crew_Defer(crew, &(crew->slow), dsq, L, seqidx, subseq_start, flt);
+  return status;
+}
+
+
+/* search_windows()
+ * Search one long target <dsq> of length <L> (sequence number <seqidx>,
+ * or its subsequence starting at <subseq_start>)
+ * only in the windows around its SSV diagonals, running the
+ * later filters and the main engine on each window's subsequence.
+ * Hits keep their window's start and length in <subseq_start> and
+ * <window_length>, with domain coords on the full target.
+ */
+static int
+search_windows(WORKER *uw, ESL_DSQ *dsq, int L, int64_t seqidx, int64_t subseq_start)
+{
+  P7_OPROFILE *om  = uw->om;
+  P7_BG       *bg  = uw->bg;
+  P7_ENGINE   *eng = uw->eng;
+  int          w;
+  int          status;
+
+  p7_bg_SetLength(bg, L);
+  p7_oprofile_ReconfigLength(om, L);
+
+  status = p7_engine_FindWindows(eng, dsq, L, om, bg, uw->crew->ssvdata, &(uw->wl));
+  p7_engine_Reuse(eng);
+  if (status != eslOK) return status;
+
+  for (w = 0; w < uw->wl.count; w++)
+    {
+      status = search_one(uw, dsq + uw->wl.windows[w].n - 1, uw->wl.windows[w].length, seqidx, subseq_start + uw->wl.windows[w].n - 1, FALSE, FALSE);
+      if (status != eslOK && status != eslFAIL) return status;
+    }
+  return eslOK;
+}
+
+
+/* crew_Report()
+ * Print one line per worker of chunks, sequences, and wall time spent
+ * waiting on the reader, processing, and finishing up after EOF.
+ * Lines start with <prefix>, so they can be picked out of a report.
+ */
+static void
+crew_Report(FILE *ofp, CREW *crew, char *prefix)
+{
+  int u;
+
+  for (u = 0; u < crew->nworkers; u++)
+    fprintf(ofp, "%s %6d %10" PRId64 " %10" PRId64 " %12" PRId64 " %9.3f %9.3f %9.3f\n",
+	    prefix, u, crew->uw[u]->nchunks, crew->uw[u]->nseq, crew->uw[u]->nres,
+	    crew->uw[u]->t_read, crew->uw[u]->t_proc, crew->uw[u]->t_eof);
+}
+
+
+/* report_hits()
+ * Calculate each hit's Forward P-value, and flag non-duplicate hits
+ * with E-value <= <E> in a search of <Z> targets as reported.
+ * Return the number of reported hits.
+ */
+static int
+report_hits(P7_TOPHITS *th, const P7_PROFILE *gm, int64_t Z, double E)
+{
+  int nreported = 0;
+  int h;
+
+  for (h = 0; h < th->N; h++)
+    {
+      th->hit[h]->lnP     = esl_exp_logsurv(th->hit[h]->score, gm->evparam[p7_FTAU], gm->evparam[p7_FLAMBDA]);
+      th->hit[h]->pre_lnP = th->hit[h]->lnP;
+      if (! (th->hit[h]->flags & p7_IS_DUPLICATE) && exp(th->hit[h]->lnP) * (double) Z <= E)
+	{
+	  th->hit[h]->flags |= p7_IS_REPORTED;
+	  nreported++;
+	}
+    }
+  return nreported;
+}
+
+
+/* drop_cache()
+ * Ask the kernel to drop the dsqdata files of database <basename>
+ * from the page cache, so the next pass reads them from disk: a
+ * simulated cold start that doesn't need root to purge the whole
+ * cache. Returns <eslOK> if at least one file was dropped, <eslFAIL>
+ * if none could be, and <eslEUNIMPLEMENTED> if the system has no
+ * posix_fadvise().
+ */
+static int
+drop_cache(char *basename)
+{
+#ifdef POSIX_FADV_DONTNEED
+  char *suffix[4] = { "", ".dsqi", ".dsqm", ".dsqs" };
+  char *path      = NULL;
+  int   ndropped  = 0;
+  int   fd, k;
+  int   status;
+
+  for (k = 0; k < 4; k++)
+    {
+      if ((status = esl_sprintf(&path, "%s%s", basename, suffix[k])) != eslOK) return status;
+      if ((fd = open(path, O_RDONLY)) >= 0)
+	{
+	  if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) ndropped++;
+	  close(fd);
+	}
+      free(path);
+      path = NULL;
+    }
+  return (ndropped ? eslOK : eslFAIL);
+#else
+  return eslEUNIMPLEMENTED;
+#endif
+}
+
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range  toggles reqs incomp  help                               docgroup*/
   { "-h",        eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "show brief help on version and usage",  0 },
   { "-n",        eslARG_INT,     "1",  NULL, NULL,   NULL,  NULL, NULL, "set number of threads to <n>",          0 },
   { "-s",        eslARG_INT,     "0",  NULL, NULL,   NULL,  NULL, NULL, "set random number seed to <n>",         0 },
+  { "-E",        eslARG_REAL,  "10.0", NULL, "x>0",  NULL,  NULL, NULL, "report hits with E-value <= <x>",       0 },
+  { "--window",  eslARG_INT,    NULL,  NULL, "n>0",  NULL,  NULL, NULL, "search targets of length >= <n> in SSV windows", 0 },
+  { "--split",   eslARG_INT,    NULL,  NULL, "n>0",  NULL,  NULL, NULL, "split targets longer than <n> across threads",   0 },
+  { "--cache",   eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "size checkpoint matrices to each thread's share of cache", 0 },
+  { "--membudget",eslARG_INT,   NULL,  NULL, "n>0",  NULL,  NULL, NULL, "limit all threads' DP matrices to <n> MB in total",     0 },
+  { "--quarantine",eslARG_REAL, NULL,  NULL, "x>0",  NULL,  NULL, NULL, "set aside targets predicted to cost > <x> million sparse cells; run them one worker at a time", 0 },
+  { "--stats",   eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "collect engine stats (filter funnel, mask density), and print totals over all threads", 0 },
+  { "--memreport",eslARG_NONE, FALSE,  NULL, NULL,   NULL,  NULL, NULL, "report each thread's DP memory: current and peak size of each structure", 0 },
+  { "--timing",  eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "time each engine stage, and print totals over all threads", 0 },
+  { "--counters",eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "count cycles, cache and branch misses in each engine stage (Linux perf_event)", 0 },
+  { "--latency", eslARG_NONE,  FALSE,  NULL, NULL,   NULL,  NULL, NULL, "histogram each comparison's latency, and list the slowest, per thread and overall", 0 },
+  { "--qlog",    eslARG_OUTFILE,NULL,  NULL, NULL,   NULL,"--quarantine", NULL, "log cost of each quarantined target to file <f>", 0 },
+  { "--bench",   eslARG_STRING, NULL,  NULL, NULL,   NULL,  NULL, NULL, "benchmark: sweep comma-separated thread counts <s> (e.g. 1,2,4,8), not -n", 0 },
+  { "--trace",   eslARG_OUTFILE,NULL,  NULL, NULL,   NULL,  NULL, "--bench", "write a Chrome trace (JSON) of each thread's activity to file <f>", 0 },
+  { "--cold",    eslARG_NONE,  FALSE,  NULL, NULL,   NULL,"--bench", NULL, "benchmark: also run each thread count cold, after dropping the db from cache", 0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile> <seqfile>";
@@ -210,13 +861,58 @@ main(int argc, char **argv)
   P7_OPROFILE    *om      = NULL;
   ESL_DSQDATA    *dd      = NULL;
   CREW           *crew    = NULL;
-  int             ncore   = esl_opt_GetInteger(go, "-n");
+  P7_SCOREDATA   *ssvdata = NULL;
+  P7_MEMGOV      *mg      = NULL;
+  P7_ENGINE_STATS *stats  = NULL;
+  FILE           *qlogfp  = NULL;
+  CREWOPTS        opts;
+  P7_TIMELINE    *tl      = NULL;
+  FILE           *tracefp = NULL;
+  char            tname[32];
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  double          qcost   = (esl_opt_IsOn(go, "--quarantine") ? 1e6 * esl_opt_GetReal(go, "--quarantine") : 0.);
+  int             do_bench= esl_opt_IsOn(go, "--bench");
+  int             do_cold = esl_opt_GetBoolean(go, "--cold");
+  char           *passname[2] = { "cold", "warm" };
+  double          t_base[2]   = { 0., 0. };
+  char           *benchstr= NULL;
+  char           *tok;
+  int            *ncpu    = NULL;
+  int             nn      = 0;
+  int             ncore;
+  int             wmin    = (esl_opt_IsOn(go, "--window") ? esl_opt_GetInteger(go, "--window") : 0);
+  int             splitlen= (esl_opt_IsOn(go, "--split")  ? esl_opt_GetInteger(go, "--split")  : 0);
+  int             overlap = 0;
+  int64_t         budget  = 0;
+  int64_t         nseq;
+  int             nhits;
+  int             u, r, pass;
   int             status;
 
+  /* Thread counts to run: just -n, unless we're benchmarking a sweep */
+  if (do_bench) {
+    if (esl_strdup(esl_opt_GetString(go, "--bench"), -1, &benchstr) != eslOK) p7_Fail("allocation failed");
+    if ((ncpu = malloc(sizeof(int) * (strlen(benchstr) / 2 + 1))) == NULL)  p7_Fail("allocation failed");
+    for (tok = strtok(benchstr, ","); tok; tok = strtok(NULL, ","))
+      if ((ncpu[nn++] = atoi(tok)) <= 0) p7_Fail("bad thread count %s in --bench", tok);
+    if (nn == 0) p7_Fail("--bench needs at least one thread count");
+  } else {
+    if ((ncpu = malloc(sizeof(int))) == NULL) p7_Fail("allocation failed");
+    ncpu[nn++] = esl_opt_GetInteger(go, "-n");
+  }
+
   /* Read in one HMM */
   if (p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
   if (p7_hmmfile_Read(hfp, &abc, &hmm)            != eslOK) p7_Fail("Failed to read HMM");
+  if (! (hmm->flags & p7H_STATS))                           p7_Fail("HMM %s has no E-value parameters (STATS lines); calibrate it first", hmm->name);
  
+  /* Windowed and split searches need the model's maximum length, to size windows */
+  if ((wmin || splitlen) && hmm->max_length < 0) p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA);
+  if (splitlen) {
+    overlap = hmm->max_length;
+    if (splitlen <= overlap) p7_Fail("--split length must exceed the model's maximum length (%d)", overlap);
+  }
+
   /* Configure a profile from the HMM */
   bg = p7_bg_Create(abc);
   gm = p7_profile_Create (hmm->M, abc);
@@ -226,20 +922,170 @@ main(int argc, char **argv)
 
   p7_bg_SetFilter(bg, om->M, om->compo);
 
-  /* Open sequence database */
-  status = esl_dsqdata_Open(&abc, seqfile, ncore, &dd);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open dsqdata files:\n  %s",    dd->errbuf);
-  else if (status == eslEFORMAT)   p7_Fail("Format problem in dsqdata files:\n  %s", dd->errbuf);
-  else if (status != eslOK)        p7_Fail("Unexpected error in opening dsqdata (code %d)", status);
+  if (wmin) {
+    if ((ssvdata = p7_hmm_ScoreDataCreate(om, FALSE))    == NULL)  p7_Fail("Failed to create SSV score data");
+    if (p7_hmm_ScoreDataComputeRest(om, ssvdata)         != eslOK) p7_Fail("Failed to compute window lengths");
+  }
+
+  /* Optional log of quarantined targets */
+  if (esl_opt_IsOn(go, "--qlog")) {
+    if ((qlogfp = fopen(esl_opt_GetString(go, "--qlog"), "w")) == NULL) p7_Fail("Failed to open quarantine log %s for writing", esl_opt_GetString(go, "--qlog"));
+    fprintf(qlogfp, "# %-8s %10s %8s %10s %8s %6s %8s %12s %10s %s\n", "seqidx", "start", "L", "ncells", "nrow", "S", "ffbits", "pred_cost", "main_sec", "status");
+  }
+
+  /* How the crew searches; the memory governor is set per pass, below */
+  opts.ssvdata     = ssvdata;
+  opts.wmin        = wmin;
+  opts.splitlen    = splitlen;
+  opts.overlap     = overlap;
+  opts.do_cache    = esl_opt_GetBoolean(go, "--cache");
+  opts.mg          = NULL;
+  opts.qcost       = qcost;
+  opts.qlogfp      = qlogfp;
+  opts.do_stats    = esl_opt_GetBoolean(go, "--stats");
+  opts.do_timing   = esl_opt_GetBoolean(go, "--timing");
+  opts.do_counters = esl_opt_GetBoolean(go, "--counters");
+  opts.do_memory   = esl_opt_GetBoolean(go, "--memreport");
+  opts.do_latency  = esl_opt_GetBoolean(go, "--latency");
 
-  /* Create the work crew */
-  crew = crew_Create(dd, gm, om, bg, ncore);
+  if (do_bench) {
+    printf("# px scaling benchmark\n");
+    printf("# query:     %s (M=%d)\n", hmmfile, gm->M);
+    printf("# database:  %s\n", seqfile);
+    printf("# Lines starting with \"run\" summarize each pass (real/user/sys in seconds, as time(1) would;\n");
+    printf("# speedup is relative to the first thread count's pass of the same kind). Lines starting with\n");
+    printf("# \"thr\" break a pass down by worker: time blocked waiting for the reader, processing, and after EOF.\n");
+    printf("# %-3s %4s %4s %9s %9s %9s %7s %10s %12s %6s\n", "run", "ncpu", "pass", "real", "user", "sys", "speedup", "nseq", "nres", "hits");
+    printf("# %-3s %4s %4s %6s %10s %10s %12s %9s %9s %9s\n", "thr", "ncpu", "pass", "thread", "chunks", "nseq", "nres", "read", "process", "eof");
+  }
+
+  /* One pass per thread count; with --cold, each is run cold and then warm */
+  for (r = 0; r < nn; r++)
+    for (pass = (do_cold ? 0 : 1); pass < 2; pass++)
+      {
+	ncore = ncpu[r];
+	if (pass == 0) {
+	  status = drop_cache(seqfile);
+	  if      (status == eslEUNIMPLEMENTED) p7_Fail("--cold needs posix_fadvise(), which this system lacks");
+	  else if (status != eslOK)             p7_Fail("Failed to drop %s from the page cache", seqfile);
+	}
+
+	esl_stopwatch_Start(w);
+
+	/* Open sequence database */
+	status = esl_dsqdata_Open(&abc, seqfile, ncore, &dd);
+	if      (status == eslENOTFOUND) p7_Fail("Failed to open dsqdata files:\n  %s",    dd->errbuf);
+	else if (status == eslEFORMAT)   p7_Fail("Format problem in dsqdata files:\n  %s", dd->errbuf);
+	else if (status != eslOK)        p7_Fail("Unexpected error in opening dsqdata (code %d)", status);
+
+	/* Optional memory budget, shared by the crew's engines */
+	if (esl_opt_IsOn(go, "--membudget")) {
+	  budget = ESL_MBYTES((int64_t) esl_opt_GetInteger(go, "--membudget"));
+	  if ((mg = p7_memgov_Create(budget, budget / ncore)) == NULL) p7_Fail("Failed to create memory governor");
+	}
+
+	/* Create the work crew */
+	opts.mg = mg;
+	crew = crew_Create(dd, gm, om, bg, &opts, ncore);
+	if (! crew) p7_Fail("Failed to create work crew");
+
+	/* Optional timeline of each worker's activity */
+	if (esl_opt_IsOn(go, "--trace")) {
+	  if ((tl = p7_timeline_Create(ncore, 0)) == NULL) p7_Fail("Failed to create timeline");
+	  for (u = 0; u < ncore; u++) { snprintf(tname, 32, "worker %d", u); p7_timeline_SetTrackName(tl, u, tname); }
+	  crew->tl = tl;
+	}
   
-  crew_Start(crew);
-  crew_Finish(crew);
+	crew_Start(crew);
+	crew_Finish(crew);
 
-  crew_Destroy(crew);
-  esl_dsqdata_Close(dd);
+	/* Comparisons that didn't fit the memory budget run last, one at a time */
+	if (crew->big.n) {
+	  printf("deferred: %d\n", crew->big.n - crew->big.head);
+	  if (crew_RunDeferred(crew) != eslOK) p7_Fail("Failed to run deferred comparisons");
+	}
+	esl_stopwatch_Stop(w);
+	if (mg) p7_memgov_Dump(stdout, mg);
+
+	if (tl) {
+	  if ((tracefp = fopen(esl_opt_GetString(go, "--trace"), "w")) == NULL) p7_Fail("Failed to open trace file %s for writing", esl_opt_GetString(go, "--trace"));
+	  if (p7_timeline_Write(tracefp, tl) != eslOK) p7_Fail("Failed to write trace file %s", esl_opt_GetString(go, "--trace"));
+	  if (p7_timeline_Dropped(tl)) printf("# trace: %" PRId64 " oldest events dropped from full buffers\n", p7_timeline_Dropped(tl));
+	  fclose(tracefp);
+	  p7_timeline_Destroy(tl);
+	  tl = NULL;
+	}
+
+	/* Engine stats, stage timings and counters, summed over the crew */
+	if (esl_opt_GetBoolean(go, "--stats") || esl_opt_GetBoolean(go, "--timing") || esl_opt_GetBoolean(go, "--counters")) {
+	  if ((stats = p7_engine_stats_Create()) == NULL) p7_Fail("Failed to create engine stats");
+	  for (u = 0; u < crew->nworkers; u++) p7_engine_stats_Merge(stats, crew->uw[u]->eng->stats);
+	  p7_engine_stats_Dump(stdout, stats);
+	  p7_engine_stats_Destroy(stats);
+	}
+
+	/* Memory footprint of each worker: its profiles, and its engine's DP structures */
+	if (esl_opt_GetBoolean(go, "--memreport"))
+	  for (u = 0; u < crew->nworkers; u++)
+	    {
+	      printf("# worker %d: profile %.2f MB, vector profile %.2f MB\n", u,
+		     (double) p7_profile_Sizeof(crew->uw[u]->gm) / 1048576., (double) p7_oprofile_Sizeof(crew->uw[u]->om) / 1048576.);
+	      p7_engine_stats_DumpMemory(stdout, crew->uw[u]->eng->stats);
+	    }
+
+	/* Comparison latencies: each worker's, then the crew's together */
+	if (esl_opt_GetBoolean(go, "--latency")) {
+	  if ((stats = p7_engine_stats_Create()) == NULL) p7_Fail("Failed to create engine stats");
+	  for (u = 0; u < crew->nworkers; u++)
+	    {
+	      printf("# worker %d latency:\n", u);
+	      p7_engine_stats_DumpLatency(stdout, crew->uw[u]->eng->stats);
+	      p7_engine_stats_Merge(stats, crew->uw[u]->eng->stats);
+	    }
+	  printf("# all workers latency:\n");
+	  p7_engine_stats_DumpLatency(stdout, stats);
+	  p7_engine_stats_Destroy(stats);
+	}
+
+	/* Gather hits, drop ones found twice in overlapping split windows,
+	 * and report the ones that pass the E-value threshold.
+	 */
+	for (u = 1; u < crew->nworkers; u++) p7_tophits_Merge(crew->uw[0]->th, crew->uw[u]->th);
+	p7_tophits_RemoveDuplicates(crew->uw[0]->th);
+	for (nseq = 0, u = 0; u < crew->nworkers; u++) nseq += crew->uw[u]->nseq;
+	nhits = report_hits(crew->uw[0]->th, gm, nseq, esl_opt_GetReal(go, "-E"));
+
+	if (do_bench)
+	  {
+	    int64_t nres = 0;
+	    char    prefix[32];
+
+	    if (r == 0) t_base[pass] = w->elapsed;
+	    for (u = 0; u < crew->nworkers; u++) nres += crew->uw[u]->nres;
+	    printf("  %-3s %4d %4s %9.3f %9.3f %9.3f %7.2f %10" PRId64 " %12" PRId64 " %6d\n",
+		   "run", ncore, passname[pass], w->elapsed, w->user, w->sys, 
+		   (w->elapsed > 0. ? t_base[pass] / w->elapsed : 0.), nseq, nres, nhits);
+	    snprintf(prefix, 32, "  %-3s %4d %4s", "thr", ncore, passname[pass]);
+	    crew_Report(stdout, crew, prefix);
+	    fflush(stdout);
+	  }
+	else
+	  {
+	    printf("# %-6s %6s %10s %10s %12s %9s %9s %9s\n", "", "thread", "chunks", "nseq", "nres", "read", "process", "eof");
+	    crew_Report(stdout, crew, "thread:");
+	    printf("hits: %d\n", nhits);
+	  }
+
+	crew_Destroy(crew);
+	esl_dsqdata_Close(dd);
+	if (mg) { p7_memgov_Destroy(mg); mg = NULL; }
+      }
+
+  if (qlogfp)  fclose(qlogfp);
+  if (ssvdata) p7_hmm_ScoreDataDestroy(ssvdata);
+  if (benchstr) free(benchstr);
+  free(ncpu);
+  esl_stopwatch_Destroy(w);
   p7_oprofile_Destroy(om);
   p7_profile_Destroy(gm);
   p7_hmm_Destroy(hmm);
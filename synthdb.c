@@ -0,0 +1,247 @@
+/* synthdb: make a synthetic dsqdata target database for benchmarking px.
+ *
+ * Samples a query model with p7_modelsample(), then N target
+ * sequences, of which a known number are homologs of the query:
+ * a domain emitted from the model, embedded at a random position in
+ * background sequence. Background is either i.i.d. residues from the
+ * null model, or shuffled sequence emitted from the query model
+ * itself (decoys with the query's composition, which is the hard case
+ * for the bias filter). Target lengths follow one of a few
+ * distributions: UniProt-like, metagenomic read fragments, or long
+ * genomic ORFs.
+ *
+ * Writes <basename>.hmm (the query) and the dsqdata files
+ * <basename>, <basename>.dsqi, .dsqm, .dsqs, so
+ *    ./px <basename>.hmm <basename>
+ * searches a database whose filter pass rate and main engine load are
+ * known in advance, and the same seed makes the same database.
+ */
+#include "p7_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_dsqdata.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer/src/hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type       default    env  range      toggles reqs incomp  help                                                   docgroup*/
+  { "-h",        eslARG_NONE,     FALSE,  NULL, NULL,       NULL,  NULL, NULL, "show brief help on version and usage",                        0 },
+  { "-s",        eslARG_INT,       "42",  NULL, NULL,       NULL,  NULL, NULL, "set random number seed to <n>",                               0 },
+  { "-M",        eslARG_INT,      "200",  NULL, "n>0",      NULL,  NULL, NULL, "length of the query model",                                   0 },
+  { "-N",        eslARG_INT,   "100000",  NULL, "n>0",      NULL,  NULL, NULL, "number of target sequences",                                  0 },
+  { "-L",        eslARG_INT,       NULL,  NULL, "0<n<=100000",NULL,  NULL, NULL, "all targets have length <n>, instead of --lendist",           0 },
+  { "--fhom",    eslARG_REAL,    "0.01",  NULL, "0<=x<=1",  NULL,  NULL, NULL, "fraction of targets that carry a homologous domain",          0 },
+  { "--lendist", eslARG_STRING,"uniprot", NULL, NULL,       NULL,  NULL, "-L", "target lengths: uniprot | reads | genomic",                   0 },
+  { "--shuffled",eslARG_NONE,     FALSE,  NULL, NULL,       NULL,  NULL, NULL, "background is shuffled query emissions, not i.i.d.",          0 },
+  { "--local",   eslARG_NONE,     FALSE,  NULL, NULL,       NULL,  NULL, NULL, "homologs are local domains, not full length",                 0 },
+  { "--truth",   eslARG_OUTFILE,   NULL,  NULL, NULL,       NULL,  NULL, NULL, "save each target's homolog coords to file <f>",               0 },
+  { "--keepfa",  eslARG_NONE,     FALSE,  NULL, NULL,       NULL,  NULL, NULL, "keep the intermediate FASTA file <basename>.fa",              0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <basename>";
+static char banner[] = "make a synthetic dsqdata database with a known number of homologs";
+
+enum synth_lendist_e { LEN_FIXED, LEN_UNIPROT, LEN_READS, LEN_GENOMIC };
+
+/* sample_length()
+ * Sample one target length. The distributions are rough fits,
+ * good enough to get the mix of short and long targets right:
+ *   uniprot: lognormal, median ~270, mean ~330 (Swiss-Prot-like)
+ *   reads:   ~N(80,15): translated ORF fragments of 150-300nt reads
+ *   genomic: lognormal, median ~20000: long ORFs/translated contigs,
+ *            truncated at 100000, the longest target the engine's
+ *            checkpointed matrix takes without px --split/--window
+ */
+static int
+sample_length(ESL_RANDOMNESS *rng, enum synth_lendist_e dist, int fixedL)
+{
+  double L;
+
+  switch (dist) {
+  case LEN_FIXED:   return fixedL;
+  case LEN_UNIPROT: L = exp(esl_rnd_Gaussian(rng, 5.6, 0.65)); return (int) ESL_MIN(ESL_MAX(L, 20.),   35000.);
+  case LEN_READS:   L =     esl_rnd_Gaussian(rng, 80., 15.);   return (int) ESL_MIN(ESL_MAX(L, 20.),     150.);
+  case LEN_GENOMIC: L = exp(esl_rnd_Gaussian(rng, 9.9, 0.8));  return (int) ESL_MIN(ESL_MAX(L, 1000.),  100000.);
+  }
+  return fixedL;
+}
+
+/* emit_background()
+ * Fill <sq> with <L> residues of background. i.i.d. from <bg>, or
+ * if <do_shuffle>, emissions of <hmm> concatenated and shuffled;
+ * <tmp> and <pool> are workspace.
+ */
+static int
+emit_background(ESL_RANDOMNESS *rng, const P7_HMM *hmm, const P7_BG *bg, int do_shuffle, int L,
+		ESL_SQ *tmp, ESL_DSQ **pool, int *pool_alloc, ESL_SQ *sq)
+{
+  int n;
+  int status;
+
+  esl_sq_GrowTo(sq, L);
+  if (! do_shuffle)
+    esl_rsq_xfIID(rng, bg->f, bg->abc->K, L, sq->dsq);
+  else
+    {
+      if (*pool_alloc < L+2) {
+	ESL_REALLOC(*pool, sizeof(ESL_DSQ) * (L+2));
+	*pool_alloc = L+2;
+      }
+      (*pool)[0] = eslDSQ_SENTINEL;
+      for (n = 0; n < L; n += (int) ESL_MIN(tmp->n, L-n))
+	{
+	  esl_sq_Reuse(tmp);
+	  p7_CoreEmit(rng, hmm, tmp, NULL);
+	  memcpy(*pool + n + 1, tmp->dsq + 1, sizeof(ESL_DSQ) * ESL_MIN(tmp->n, L-n));
+	}
+      (*pool)[L+1] = eslDSQ_SENTINEL;
+      esl_rsq_XShuffle(rng, *pool, L, sq->dsq);
+    }
+  sq->n = L;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go       = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *basename = esl_opt_GetArg(go, 1);
+  ESL_RANDOMNESS *rng      = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc      = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg       = p7_bg_Create(abc);
+  int             M        = esl_opt_GetInteger(go, "-M");
+  int             N        = esl_opt_GetInteger(go, "-N");
+  int             fixedL   = (esl_opt_IsOn(go, "-L") ? esl_opt_GetInteger(go, "-L") : 0);
+  int             do_shuffle = esl_opt_GetBoolean(go, "--shuffled");
+  int             do_local   = esl_opt_GetBoolean(go, "--local");
+  enum synth_lendist_e dist  = LEN_FIXED;
+  int             nhom     = (int) round(esl_opt_GetReal(go, "--fhom") * (double) N);
+  int             nhom_left;
+  P7_HMM         *hmm      = NULL;
+  P7_PROFILE     *gm       = NULL;
+  ESL_SQ         *sq       = esl_sq_CreateDigital(abc);
+  ESL_SQ         *dom      = esl_sq_CreateDigital(abc);
+  ESL_SQ         *tmp      = esl_sq_CreateDigital(abc);
+  ESL_DSQ        *pool     = NULL;
+  int             pool_alloc = 0;
+  ESL_SQFILE     *sqfp     = NULL;
+  FILE           *ofp      = NULL;
+  FILE           *truthfp  = NULL;
+  char           *fafile   = NULL;
+  char           *hmmfile  = NULL;
+  char            errbuf[eslERRBUFSIZE];
+  int64_t         nres     = 0;
+  int64_t         nres_hom = 0;
+  int             i, L, from;
+  int             status;
+
+  if (! fixedL)
+    {
+      if      (strcmp(esl_opt_GetString(go, "--lendist"), "uniprot") == 0) dist = LEN_UNIPROT;
+      else if (strcmp(esl_opt_GetString(go, "--lendist"), "reads")   == 0) dist = LEN_READS;
+      else if (strcmp(esl_opt_GetString(go, "--lendist"), "genomic") == 0) dist = LEN_GENOMIC;
+      else p7_Fail("--lendist must be uniprot, reads, or genomic");
+    }
+  if (esl_sprintf(&fafile,  "%s.fa",  basename) != eslOK) p7_Fail("allocation failed");
+  if (esl_sprintf(&hmmfile, "%s.hmm", basename) != eslOK) p7_Fail("allocation failed");
+
+  /* The query */
+  if (p7_modelsample(rng, M, abc, &hmm) != eslOK) p7_Fail("failed to sample an HMM");
+  p7_hmm_SetName(hmm, "synth-query");
+  if (p7_Calibrate(hmm, NULL, &rng, &bg, NULL, NULL) != eslOK) p7_Fail("failed to calibrate the HMM");
+  if ((ofp = fopen(hmmfile, "w")) == NULL) p7_Fail("Failed to open %s for writing", hmmfile);
+  if (p7_hmmfile_WriteASCII(ofp, -1, hmm) != eslOK) p7_Fail("Failed to write %s", hmmfile);
+  fclose(ofp);
+
+  /* Local homologs come from a unihit local profile with no flanks (L=0). */
+  if (do_local)
+    {
+      gm = p7_profile_Create(M, abc);
+      p7_profile_ConfigUnilocal(gm, hmm, bg, 0);
+    }
+
+  /* The targets, as FASTA. Homologs are placed by selection sampling,
+   * so there are exactly <nhom> of them, in random positions.
+   */
+  if ((ofp = fopen(fafile, "w")) == NULL) p7_Fail("Failed to open %s for writing", fafile);
+  if (esl_opt_IsOn(go, "--truth")) {
+    if ((truthfp = fopen(esl_opt_GetString(go, "--truth"), "w")) == NULL) p7_Fail("Failed to open %s for writing", esl_opt_GetString(go, "--truth"));
+    fprintf(truthfp, "# name\tL\thomolog\tfrom\tto\n");
+  }
+  for (nhom_left = nhom, i = 0; i < N; i++)
+    {
+      L = sample_length(rng, dist, fixedL);
+      esl_sq_Reuse(sq);
+
+      if (nhom_left && esl_random(rng) < (double) nhom_left / (double) (N - i))
+	{
+	  do {
+	    esl_sq_Reuse(dom);
+	    if (do_local) p7_ProfileEmit(rng, hmm, gm, bg, dom, NULL);
+	    else          p7_CoreEmit   (rng, hmm, dom, NULL);
+	  } while (dom->n == 0);
+
+	  L    = (int) ESL_MAX(L, dom->n);
+	  from = 1 + esl_rnd_Roll(rng, L - dom->n + 1);
+	  if (emit_background(rng, hmm, bg, do_shuffle, L, tmp, &pool, &pool_alloc, sq) != eslOK) p7_Fail("allocation failed");
+	  memcpy(sq->dsq + from, dom->dsq + 1, sizeof(ESL_DSQ) * dom->n);
+	  esl_sq_FormatName(sq, "synth%d", i+1);
+	  esl_sq_FormatDesc(sq, "homolog %d..%d", from, from + (int) dom->n - 1);
+	  if (truthfp) fprintf(truthfp, "synth%d\t%d\t1\t%d\t%d\n", i+1, L, from, from + (int) dom->n - 1);
+	  nres_hom += dom->n;
+	  nhom_left--;
+	}
+      else
+	{
+	  if (emit_background(rng, hmm, bg, do_shuffle, L, tmp, &pool, &pool_alloc, sq) != eslOK) p7_Fail("allocation failed");
+	  esl_sq_FormatName(sq, "synth%d", i+1);
+	  if (truthfp) fprintf(truthfp, "synth%d\t%d\t0\t-\t-\n", i+1, L);
+	}
+      esl_sqio_Write(ofp, sq, eslSQFILE_FASTA, FALSE);
+      nres += L;
+    }
+  fclose(ofp);
+  if (truthfp) fclose(truthfp);
+
+  /* FASTA to dsqdata. esl_dsqdata_Write() reads from an open ESL_SQFILE. */
+  status = esl_sqfile_OpenDigital(abc, fafile, eslSQFILE_FASTA, NULL, &sqfp);
+  if      (status == eslENOTFOUND) p7_Fail("Failed to reopen %s",               fafile);
+  else if (status != eslOK)        p7_Fail("Failed to open %s as FASTA, code %d", fafile, status);
+  if (esl_dsqdata_Write(sqfp, basename, errbuf) != eslOK) p7_Fail("Failed to write dsqdata %s:\n  %s", basename, errbuf);
+  esl_sqfile_Close(sqfp);
+  if (! esl_opt_GetBoolean(go, "--keepfa")) remove(fafile);
+
+  printf("# query:     %s (M=%d)\n", hmmfile, M);
+  printf("# targets:   %s: %d seqs, %" PRId64 " residues, mean L %.1f (%s)\n",
+	 basename, N, nres, (double) nres / (double) N, (fixedL ? "fixed -L" : esl_opt_GetString(go, "--lendist")));
+  printf("# homologs:  %d (%.4f), %s domains, %" PRId64 " homologous residues\n",
+	 nhom, (double) nhom / (double) N, (do_local ? "local" : "full length"), nres_hom);
+  printf("# background: %s\n", (do_shuffle ? "shuffled query emissions" : "i.i.d."));
+
+  free(pool);
+  free(fafile);
+  free(hmmfile);
+  esl_sq_Destroy(tmp);
+  esl_sq_Destroy(dom);
+  esl_sq_Destroy(sq);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  exit(0);
+}